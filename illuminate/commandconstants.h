@@ -51,6 +51,8 @@ int brightness_func(CommandRouter *cmd, int argc, const char **argv);
 int array_distance_func(CommandRouter *cmd, int argc, const char **argv);
 
 int set_led_func(CommandRouter *cmd, int argc, const char **argv);
+int set_led_bitmask_func(CommandRouter *cmd, int argc, const char **argv);
+int set_led_frame_func(CommandRouter *cmd, int argc, const char **argv);
 
 int clear_func(CommandRouter *cmd, int argc, const char **argv);
 int fill_func(CommandRouter *cmd, int argc, const char **argv);
@@ -70,6 +72,7 @@ int scan_darkfield_func(CommandRouter *cmd, int argc, const char **argv);
 int set_custom_sequence_length_func(CommandRouter *cmd, int argc, const char **argv);
 int set_custom_sequence_value_func(CommandRouter *cmd, int argc, const char **argv);
 int run_sequence_func(CommandRouter *cmd, int argc, const char **argv);
+int run_sequence_timed_func(CommandRouter *cmd, int argc, const char **argv);
 int print_custom_sequence_func(CommandRouter *cmd, int argc, const char **argv);
 int step_sequence_func(CommandRouter *cmd, int argc, const char **argv);
 int restart_sequence_func(CommandRouter *cmd, int argc, const char **argv);
@@ -116,12 +119,22 @@ int trigger_output_polarity_func(CommandRouter *cmd, int argc, const char **argv
 int trigger_output_delay_func(CommandRouter *cmd, int argc, const char **argv);
 int trigger_input_pin_func(CommandRouter *cmd, int argc, const char **argv);
 int trigger_output_pin_func(CommandRouter *cmd, int argc, const char **argv);
+int trigger_latency_func(CommandRouter *cmd, int argc, const char **argv);
+int trigger_trace_func(CommandRouter *cmd, int argc, const char **argv);
+int strobe_func(CommandRouter *cmd, int argc, const char **argv);
 
 int cosine_func(CommandRouter *cmd, int argc, const char **argv);
 int hw_initialize_function(CommandRouter *cmd, int argc, const char **argv);
+int pipeline_func(CommandRouter *cmd, int argc, const char **argv);
+int benchmark_func(CommandRouter *cmd, int argc, const char **argv);
 int set_single_color_func(CommandRouter *cmd, int argc, const char **argv);
 int global_shutter_func(CommandRouter *cmd, int argc, const char **argv);
 
+int set_led_binary_func(CommandRouter *cmd, uint16_t argc, const uint16_t *argv);
+int set_custom_sequence_value_binary_func(CommandRouter *cmd, uint16_t argc, const uint16_t *argv);
+int set_led_bitmask_binary_func(CommandRouter *cmd, uint16_t argc, const uint16_t *argv);
+int set_led_frame_binary_func(CommandRouter *cmd, uint16_t argc, const uint16_t *argv);
+
 // Syntax is: {short command, long command, description, syntax}
 command_item_t command_list[] = {
 
@@ -140,12 +153,14 @@ command_item_t command_list[] = {
   {"na", "Set na used for bf/df/dpc/cdpc patterns", "na.[na*100]", na_func},
   {"nai", "Sets the inner NA. (nai.20 sets an inner NA of 0.20)  Respected by bf, dpc, and rdpc commands. Default is 0", "nai.20", na_inner_func},
   {"sc", "Set LED array color balance (RGB arrays only). Note values are normalized to current brightness (set by the `sb` command)", "sc.[`red` or `green` or `blue` or `white`] --or-- sc.[red_value].[green_value].[blue_value].", color_func},
-  {"ssc", "Set single color channel by index", "ssc.[channel index].[color]", set_single_color_func},
-  {"sb", "Set LED array brightness", "sb.[rgbVal] --or-- sb.[rVal].[gVal].[bVal]", brightness_func},
+  {"ssc", "Set single color channel by index", "ssc.[channel index].[color] --or-- ssc.[channel index].[color].16 (16-bit value)", set_single_color_func},
+  {"sb", "Set LED array brightness", "sb.[rgbVal] --or-- sb.[rgbVal].16 (16-bit value) --or-- sb.[rVal].[gVal].[bVal]", brightness_func},
   {"sad", "Set LED array distance", "sad.[dist (mm)]", array_distance_func},
 
   // Single (or multiple) LED Display
   {"l", "Turn on a single LED (or multiple LEDs in a list)", "l.[led #].[led #], ...", set_led_func},
+  {"lb", "Draw a full-array pattern from a base64-encoded bitmask, where bit n of byte n / 8 (least significant bit first) turns on LED n with the current color", "lb.[base64 bitmask]", set_led_bitmask_func},
+  {"lf", "Draw a full-array frame of 16-bit intensities, one value per color channel of every LED (ordered by LED, then color channel). Cosine weighting is not applied. Intended for binary frames, since most devices need more values than fit in an ASCII command.", "lf.[led 0 channel 0].[led 0 channel 1] ...", set_led_frame_func},
 
   // General Display
   {"x", "Clear the LED array.", "x", clear_func},
@@ -169,6 +184,7 @@ command_item_t command_list[] = {
   {"ssl",   "Set sequence length, or the number of patterns to be cycles through (not the number of leds per pattern).", "ssl.[Sequence length]", set_custom_sequence_length_func},
   {"ssv",   "Set sequence value", "ssl.[# Number of LEDs], [LED number 0], [LED number 1]], [LED number 2], ...", set_custom_sequence_value_func},
   {"rseq",  "Runs sequence with specified delay between each update. May emit or wait for trigger signals depending on trigger settings. If update speed is too fast, a warning message will print.", "rseq.[(Optional - default=0) Delay between each pattern in ms].[(Optional - default=1) Number of times to execute sequence]", run_sequence_func},
+  {"rseqt", "Runs sequence from a hardware timer, with the pattern period in microseconds, returning immediately. Output triggers are sent as for rseq; input triggers are not supported. Call without arguments to print playback state, or with stop to end playback.", "rseqt.[Period of each pattern in us].[(Optional - default=1) Number of times to execute sequence] --or-- rseqt.stop", run_sequence_timed_func},
   {"pseq",  "Prints sequence values to the terminal", "pseq", print_custom_sequence_func},
   {"sseq",  "Manually step through a sequence, incrementing the current index. May emit or wait for trigger signals depending on trigger settings.", "sseq", step_sequence_func},
   {"xseq",  "Resets sequence index to the first value, leaving the sequence unchanged.", "xseq", restart_sequence_func},
@@ -219,15 +235,64 @@ command_item_t command_list[] = {
   {"troutputpulsewidth", "Sets the trigger pulse width in microseconds, default is 1000.", "troutputpulsewidth.1000", trigger_output_pulse_width_func},
   {"trinputpolarity", "Sets the trigger input polarity. 1=active high, 0=active low. Default is 1.", "trinputpolarity.1", trigger_input_polarity_func},
   {"troutputpolarity", "Sets the trigger output polarity. 1=active high, 0=active low. Default is 1.", "troutputpolarity.1", trigger_output_polarity_func},
-  {"troutputdelay", "Sets the trigger delay in microseconds. Default is zero.", "troutputdelay.0", trigger_output_delay_func},
+  {"troutputdelay", "Sets the trigger delay in microseconds, which sequences wait for after each output pulse before showing the next pattern. Default is zero.", "troutputdelay.0", trigger_output_delay_func},
   {"trinputpin", "Returns the Teensy pin of the trigger inputsignal. Used only for debugging.", "trinputpin", trigger_input_pin_func},
   {"troutputpin", "Returns the Teensy pin of the trigger outputsignal. Used only for debugging.", "troutputpin", trigger_output_pin_func},
+  {"trlatency", "Prints the latency from trigger input edges to the latch of the LED pattern which follows them (last, max and mean, in us), and the number of patterns measured.", "trlatency --or-- trlatency.reset", trigger_latency_func},
+  {"trtrace", "Prints min, mean, max and p99 of the LED latch period, latch to trigger output and trigger output to input intervals (in us), from the most recent latch and trigger edge timestamps. trtrace.dump prints the timestamps.", "trtrace --or-- trtrace.dump --or-- trtrace.reset", trigger_trace_func},
+  {"strobe", "Sets the trigger input which gates LEDs in custom sequences (strobe mode): each pattern is latched when the input becomes active (see trinputpolarity) and cleared when it becomes inactive, or after the input timeout (see trinputtimeout). strobe.-1 disables strobe mode and clears a lit pattern.", "strobe --or-- strobe.0 --or-- strobe.-1", strobe_func},
 
   {"cos", "Returns or sets the cosine factor, used to scale LED intensity (so outer LEDs are brighter). Input is cos.[integer cosine factor]", "cos.2", cosine_func},
 
   {"hwinit", "Manufacturer hardware initialization. Modifies persistant settings - do not use unless you know what you're doing.", "hwinit.[sn].[pn]", hw_initialize_function},
 
+  {"pipe", "Sets (pipe.[0/1]) or prints (pipe) pipelined command mode. When enabled, commands are queued as they arrive, errors are reported as ERROR.[id][code] and successful commands are acknowledged in batches as ACK.[last id]. Command ids restart from zero when enabled.", "pipe --or-- pipe.[0/1]", pipeline_func},
+  {"bench", "Times firmware operations on the device. bench.route prints the time (in ns) to look up each command name through the command hash table and by a linear scan of the command list, as BENCH.ROUTE.[name].[hash].[scan]. Pass a command name to time only that command. bench.tok prints the time (in ns) to tokenize an LED list (l.0.1.2...) of up to the maximum number of tokens using the current tokenizer, strtok, and strtok with a 1us delay per token (the previous tokenizer), as BENCH.TOK.[tokens].[tokenizer].[strtok].[strtok with delay]. bench.fill prints the time (in ns) to write every LED into the frame one LED at a time and as a whole array, and to clear the frame, as BENCH.FILL.[one at a time].[whole array].[clear]. bench.select prints the time (in ns) to check every LED against a half circle, quadrant and annulus (from 0.2NA to the objective NA) using the stored radial NA of each LED, and computing it per LED as was done before, as BENCH.SELECT.[half circle stored].[half circle computed].[quadrant stored].[quadrant computed].[annulus stored].[annulus computed]. The array is cleared afterwards.", "bench.route --or-- bench.route.[command name] --or-- bench.tok --or-- bench.tok.[token count] --or-- bench.fill --or-- bench.select", benchmark_func},
+
   {nullptr, nullptr, nullptr, nullptr}
 };
 
+// Opcodes for binary command frames. Entries without a binary handler are forwarded to the command_list entry of the same name.
+// Syntax is: {opcode, command name, binary handler}
+binary_command_item_t binary_command_list[] = {
+
+  // LED lists are passed as packed uint16 arrays
+  {0x01, "l", set_led_binary_func},
+  {0x02, "ssv", set_custom_sequence_value_binary_func},
+  {0x03, "lb", set_led_bitmask_binary_func},
+  {0x04, "lf", set_led_frame_binary_func},
+
+  // General Display
+  {0x10, "x", nullptr},
+  {0x11, "ff", nullptr},
+  {0x12, "bf", nullptr},
+  {0x13, "df", nullptr},
+  {0x14, "an", nullptr},
+  {0x15, "dq", nullptr},
+  {0x16, "gs", nullptr},
+
+  // System Parameters
+  {0x20, "na", nullptr},
+  {0x21, "nai", nullptr},
+  {0x22, "sb", nullptr},
+  {0x23, "ssc", nullptr},
+  {0x24, "sad", nullptr},
+  {0x25, "ac", nullptr},
+
+  // Sequences
+  {0x30, "ssl", nullptr},
+  {0x31, "rseq", nullptr},
+  {0x32, "sseq", nullptr},
+  {0x33, "xseq", nullptr},
+  {0x34, "scf", nullptr},
+  {0x35, "scb", nullptr},
+  {0x36, "scd", nullptr},
+  {0x37, "rdpc", nullptr},
+
+  // Triggering
+  {0x40, "tr", nullptr},
+
+  {0, nullptr, nullptr}
+};
+
 #endif
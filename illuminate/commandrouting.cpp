@@ -94,31 +94,133 @@ const char* error_code_list[ERROR_CODE_COUNT][2] = {
   {"COMMAND_LENGTH", "Command too long."},
 
   // Sequence full
-  {"SEQUENCE_FULL", "Sequence is full."}
+  {"SEQUENCE_FULL", "Sequence is full."},
+
+  // Binary frame
+  {"BINARY_FRAME", "Incomplete or malformed binary frame."},
+
+  // Timed sequence playback
+  {"SEQ_RUNNING", "Not allowed while a timed sequence is running (send rseqt.stop first)."}
 
 };
 
-int CommandRouter::init(command_item_t *commands, int buffer_size,
-                        char *serial_buffer, int argv_max,
-                        const char **argv_buffer)
+int CommandRouter::init(command_item_t *commands, binary_command_item_t *binary_commands,
+                        int buffer_size, char *serial_buffer, int argv_max,
+                        const char **argv_buffer, uint16_t *argument_value_buffer)
 {
   this->buffer = serial_buffer;
   this->argv = argv_buffer;
+  this->argument_values = argument_value_buffer;
   this->buffer_size = buffer_size;
   this->argv_max = argv_max;
   this->command_list = commands;
+  this->binary_command_list = binary_commands;
   this->malloc_used = false;
+  build_command_hash_table();
   return NO_ERROR;
 }
 
+/* FNV-1a hash of a command name */
+uint32_t CommandRouter::hash_command_name(const char *name)
+{
+  uint32_t hash = 2166136261UL;
+  while (*name)
+  {
+    hash ^= (uint8_t)*name++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+/* Index command_list by name so route() does not need to scan the list */
+void CommandRouter::build_command_hash_table()
+{
+  memset(command_hash_table, 0, sizeof(command_hash_table));
+
+  for (int i = 0; command_list[i].name != nullptr; i++)
+  {
+    // Leave room so that every probe sequence ends at an empty slot
+    if (i + 1 >= COMMAND_HASH_TABLE_SIZE / 2)
+    {
+      Serial.printf(F("ERROR (CommandRouter::build_command_hash_table): Too many commands for hash table.%s"), SERIAL_LINE_ENDING);
+      break;
+    }
+
+    uint32_t slot = hash_command_name(command_list[i].name) & (COMMAND_HASH_TABLE_SIZE - 1);
+    bool duplicate = false;
+    while (command_hash_table[slot] != 0)
+    {
+      // Keep the first definition of duplicated names, as a linear scan would
+      if (strcmp(command_list[command_hash_table[slot] - 1].name, command_list[i].name) == 0)
+      {
+        duplicate = true;
+        break;
+      }
+      slot = (slot + 1) & (COMMAND_HASH_TABLE_SIZE - 1);
+    }
+
+    if (!duplicate)
+      command_hash_table[slot] = i + 1;
+  }
+}
+
+/* Returns the command_list entry with the given name, or nullptr if there is none */
+command_item_t *CommandRouter::find_command(const char *name)
+{
+  uint32_t slot = hash_command_name(name) & (COMMAND_HASH_TABLE_SIZE - 1);
+  while (command_hash_table[slot] != 0)
+  {
+    command_item_t *command = &command_list[command_hash_table[slot] - 1];
+    if (strcmp(name, command->name) == 0)
+      return command;
+    slot = (slot + 1) & (COMMAND_HASH_TABLE_SIZE - 1);
+  }
+  return nullptr;
+}
+
 int CommandRouter::route(int argc, const char **argv) {
 
   if (argc == 0)
     return NO_ERROR;
 
-  for (int i = 0; command_list[i].name != nullptr; i++)
-    if (strcmp(argv[0], command_list[i].name) == 0)
-      return command_list[i].func(this, argc, argv);
+  command_item_t *command = find_command(argv[0]);
+  if (command == nullptr)
+    return ERROR_INVALID_COMMAND;
+
+  return command->func(this, argc, argv);
+}
+
+int CommandRouter::route_binary(uint8_t opcode, uint16_t argc, const uint16_t *binary_argv) {
+
+  for (int i = 0; binary_command_list[i].name != nullptr; i++)
+  {
+    if (binary_command_list[i].opcode != opcode)
+      continue;
+
+    // Commands with a native binary handler receive the packed argument list directly
+    if (binary_command_list[i].func != nullptr)
+      return binary_command_list[i].func(this, argc, binary_argv);
+
+    // Otherwise, expand the arguments to tokens and use the ASCII handler.
+    if (argc + 1 >= argv_max)
+      return ERROR_COMMAND_TOO_LONG;
+
+    char *text = binary_text;
+    char *text_end = &binary_text[BINARY_TEXT_BUFFER_SIZE];
+    argument_values_valid = false;
+    argv[0] = binary_command_list[i].name;
+    for (uint16_t arg_index = 0; arg_index < argc; arg_index++)
+    {
+      int written = snprintf(text, text_end - text, "%u", binary_argv[arg_index]);
+      if ((written < 0) || (written >= text_end - text))
+        return ERROR_COMMAND_TOO_LONG;
+      argv[arg_index + 1] = text;
+      text += written + 1;
+    }
+    argv[argc + 1] = NULL;
+
+    return route(argc + 1, argv);
+  }
 
   return ERROR_INVALID_COMMAND;
 }
@@ -144,59 +246,107 @@ int CommandRouter::help() {
 }
 
 
-int CommandRouter::process_serial_stream() {
-  int argc;
-  int bytes_read = 0;
-  int bytes_read_max = buffer_size - 1 - 1;
-  int result;
-
-  // Set input buffer to second character in input buffer
-  char *input_buffer = &this->buffer[1];
-  this->buffer[0] = '\0'; // Null terminate the return string
+int CommandRouter::set_pipeline_mode(bool enabled) {
+  pipeline_mode = enabled;
 
-  // TODO: is this limit correct?
-  while (bytes_read < bytes_read_max)
+  // Command ids restart from zero each time pipelining is enabled
+  if (enabled)
   {
-    incoming = Serial.read();
+    next_command_id = 0;
+    unacknowledged_count = 0;
+  }
+  return NO_ERROR;
+}
 
-    // Newline
-    if (incoming == '\n' || incoming == '\r')
-      break;
+bool CommandRouter::get_pipeline_mode() {
+  return pipeline_mode;
+}
 
-    input_buffer[bytes_read] = (char)incoming;
-    bytes_read++;
-  }
+int CommandRouter::dispatch_binary_frame(command_queue_entry_t *command) {
+  // Frame layout (after the magic byte): [opcode (uint8)][argc (uint16)][argc x uint16], little-endian
+  uint8_t opcode = command->binary_header[0];
+  uint16_t argc = (uint16_t)command->binary_header[1] | ((uint16_t)command->binary_header[2] << 8);
+
+  // Teensy is little-endian, so the payload can be used in place
+  uint16_t *binary_argv = (uint16_t *)&this->buffer[command->offset];
 
-  // Flush remaining parts of serial buffer
-  if (bytes_read == bytes_read_max)
+  return route_binary(opcode, argc, binary_argv);
+}
+
+/* Split a line into argv in place, in a single pass. Empty tokens are skipped, as with strtok.
+   Arguments are also converted to integers as they are scanned, so that handlers taking lists of
+   LED indicies can use argument_values rather than converting each token again.
+   Returns the number of tokens, or -1 if there are too many for argv. */
+int CommandRouter::tokenize(char *line)
+{
+  int argc = 0;
+  char *c = line;
+  argument_values_valid = true;
+
+  while (true)
   {
-    while (true)
+    while (*c == DELIMETER)
+      c++;
+    if (*c == '\0')
+      break;
+
+    // Leave room for the terminating NULL
+    if (argc + 1 >= argv_max)
+      return -1;
+    argv[argc] = c;
+
+    uint32_t value = 0;
+    bool numeric = true;
+    for (; (*c != DELIMETER) && (*c != '\0'); c++)
     {
-      incoming = Serial.read();
-      if (incoming == '\n' || incoming == '\r')
-        break;
+      if ((*c >= '0') && (*c <= '9'))
+      {
+        if (value <= UINT16_MAX)
+          value = value * 10 + (*c - '0');
+      }
+      else
+        numeric = false;
     }
-    return ERROR_COMMAND_TOO_LONG;
-  }
 
-  if (bytes_read == 0)
-    return NO_ERROR;
+    // Leading zeros are left to the handler, since strtoul reads these as octal or hex
+    if ((argv[argc][0] == '0') && (c - argv[argc] > 1))
+      numeric = false;
 
-  // Set null terminating character
-  input_buffer[bytes_read] = '\0';
+    if (argc > 0)
+    {
+      if (numeric && (value <= UINT16_MAX))
+        argument_values[argc - 1] = (uint16_t)value;
+      else
+        argument_values_valid = false;
+    }
+    argc++;
 
-  // Tokenize strings
-  argc = 0;
-  argv[argc] = strtok(input_buffer, ".");
-  while (argv[argc] != NULL)
-  {
-    delayMicroseconds(1); // For teensy 4.0
-    argv[++argc] = strtok(NULL, ".");
+    if (*c == '\0')
+      break;
+    *c++ = '\0';
   }
 
+  argv[argc] = NULL;
+  return argc;
+}
+
+/* Returns true (and the values of argv[1...]) if every argument of the current command is a decimal integer */
+bool CommandRouter::get_argument_values(const uint16_t **values)
+{
+  *values = argument_values;
+  return argument_values_valid;
+}
+
+int CommandRouter::dispatch_line(char *line) {
+  int argc = tokenize(line);
+  if (argc < 0)
+    return ERROR_COMMAND_TOO_LONG;
+
   // Call route command
-  result = route(argc, argv);
+  return route(argc, argv);
+}
 
+void CommandRouter::print_result(int result) {
   // Print the error message, if any
   if (result > 0)
   {
@@ -207,6 +357,309 @@ int CommandRouter::process_serial_stream() {
   }
   else
     Serial.printf("%s%s", COMMAND_END, SERIAL_LINE_ENDING);
+}
+
+void CommandRouter::print_acknowledgement() {
+  // A single acknowledgement covers every command up to and including last_completed_id
+  if (unacknowledged_count > 0)
+    Serial.printf("ACK.%u%s", last_completed_id, SERIAL_LINE_ENDING);
+  unacknowledged_count = 0;
+}
+
+void CommandRouter::enqueue_command(uint8_t type, int length) {
+  command_queue_entry_t *command = &command_queue[(queue_head + queue_count) % COMMAND_QUEUE_LENGTH];
+  command->id = next_command_id++;
+  command->type = type;
+  command->offset = assembly_offset;
+  command->length = length;
+  memcpy(command->binary_header, binary_header, sizeof(binary_header));
+  queue_count++;
+
+  // Assemble the next command after this one (leaving room for a null terminator),
+  // keeping binary payloads two-byte aligned so they can be used in place.
+  if (type != COMMAND_TYPE_ERROR)
+    assembly_offset = (assembly_offset + length + 2) & ~1;
+
+  stream_state = STREAM_STATE_ASCII;
+  bytes_read = 0;
+}
+
+void CommandRouter::assemble_commands() {
+  // Without pipelining, each command is executed before the next one is read
+  int queue_capacity = pipeline_mode ? COMMAND_QUEUE_LENGTH : 1;
+
+  // Abandon binary frames which stall part-way through
+  if ((queue_count < queue_capacity) && (stream_state >= STREAM_STATE_BINARY_HEADER) &&
+      !Serial.available() && (millis() - last_byte_time_ms > BINARY_FRAME_TIMEOUT_MS))
+  {
+    enqueue_command(COMMAND_TYPE_ERROR, ERROR_BINARY_FRAME);
+    return;
+  }
+
+  // Consume whatever has arrived without waiting for more, until the queue is full.
+  while ((queue_count < queue_capacity) && Serial.available())
+  {
+    // If the command being assembled has run out of room, leave the remaining bytes unread
+    // until the queued commands ahead of it have executed and the buffer has been compacted.
+    if ((queue_count > 0) &&
+        (((stream_state == STREAM_STATE_ASCII) && (assembly_offset + bytes_read + 2 > buffer_size)) ||
+         ((stream_state == STREAM_STATE_BINARY_PAYLOAD) && (assembly_offset + (int)binary_payload_size > buffer_size))))
+      break;
+
+    incoming = Serial.read();
+    if (incoming < 0)
+      break;
+    last_byte_time_ms = millis();
+
+    switch (stream_state)
+    {
+      case STREAM_STATE_ASCII:
+        // Binary frames are identified by their first byte
+        if ((bytes_read == 0) && (incoming == BINARY_FRAME_MAGIC))
+        {
+          stream_state = STREAM_STATE_BINARY_HEADER;
+        }
+        else if (incoming == '\n' || incoming == '\r')
+        {
+          // Ignore empty lines
+          if (bytes_read == 0)
+            break;
+
+          this->buffer[assembly_offset + bytes_read] = '\0';
+          enqueue_command(COMMAND_TYPE_ASCII, bytes_read);
+        }
+        else if (assembly_offset + bytes_read + 2 > buffer_size)
+          stream_state = STREAM_STATE_DISCARD_LINE;
+        else
+          this->buffer[assembly_offset + bytes_read++] = (char)incoming;
+        break;
+
+      case STREAM_STATE_DISCARD_LINE:
+        // Flush remaining parts of a command which is too long
+        if (incoming == '\n' || incoming == '\r')
+          enqueue_command(COMMAND_TYPE_ERROR, ERROR_COMMAND_TOO_LONG);
+        break;
+
+      case STREAM_STATE_BINARY_HEADER:
+        binary_header[bytes_read++] = (uint8_t)incoming;
+        if (bytes_read == sizeof(binary_header))
+        {
+          binary_payload_size = (((uint16_t)binary_header[1]) | ((uint16_t)binary_header[2] << 8)) * sizeof(uint16_t);
+          bytes_read = 0;
+
+          if (binary_payload_size == 0)
+            enqueue_command(COMMAND_TYPE_BINARY, 0);
+
+          // Discard the payload if it cannot fit in the serial buffer
+          else if (binary_payload_size > (size_t)buffer_size)
+            stream_state = STREAM_STATE_DISCARD_BINARY;
+          else
+            stream_state = STREAM_STATE_BINARY_PAYLOAD;
+        }
+        break;
+
+      case STREAM_STATE_BINARY_PAYLOAD:
+        this->buffer[assembly_offset + bytes_read++] = (char)incoming;
+        if ((size_t)bytes_read == binary_payload_size)
+          enqueue_command(COMMAND_TYPE_BINARY, bytes_read);
+        break;
+
+      case STREAM_STATE_DISCARD_BINARY:
+        if ((size_t)++bytes_read == binary_payload_size)
+          enqueue_command(COMMAND_TYPE_ERROR, ERROR_COMMAND_TOO_LONG);
+        break;
+    }
+  }
+}
+
+int CommandRouter::dispatch_next_command() {
+  command_queue_entry_t *command = &command_queue[queue_head];
+  uint16_t id = command->id;
+  int result;
+
+  // Report in the mode the command was received in, so that toggling pipelining is reported consistently
+  bool pipelined = pipeline_mode;
+
+  if (command->type == COMMAND_TYPE_ASCII)
+    result = dispatch_line(&this->buffer[command->offset]);
+  else if (command->type == COMMAND_TYPE_BINARY)
+    result = dispatch_binary_frame(command);
+  else
+    result = command->length;
+
+  queue_head = (queue_head + 1) % COMMAND_QUEUE_LENGTH;
+  queue_count--;
+
+  // Once the queue has drained, move the partially assembled command back to the start of the buffer
+  if ((queue_count == 0) && (assembly_offset > 0))
+  {
+    if ((stream_state == STREAM_STATE_ASCII) || (stream_state == STREAM_STATE_BINARY_PAYLOAD))
+      memmove(this->buffer, &this->buffer[assembly_offset], bytes_read);
+    assembly_offset = 0;
+  }
+
+  if (!pipelined)
+  {
+    print_result(result);
+    return result;
+  }
+
+  // Errors are reported immediately, successes are acknowledged in batches
+  if (result > 0)
+  {
+    if (result < ERROR_CODE_COUNT)
+      Serial.printf("ERROR.%u[%d]: %s\n", id, result, error_code_list[result][1]);
+    else
+      Serial.printf("ERROR.%u[%d]: INVALID ERROR CODE\n", id, result);
+  }
+
+  last_completed_id = id;
+  if ((++unacknowledged_count >= COMMAND_ACK_BATCH_SIZE) || (queue_count == 0) || !pipeline_mode)
+    print_acknowledgement();
 
   return result;
 }
+
+int CommandRouter::process_serial_stream() {
+  // Read as much as can be queued, then execute at most one command so that other work can run in between
+  assemble_commands();
+  if (queue_count == 0)
+    return NO_ERROR;
+
+  return dispatch_next_command();
+}
+
+/* Times command processing steps on the device, so changes to them can be checked */
+int CommandRouter::benchmark(int argc, const char **argv)
+{
+  if (argc < 2)
+    return ERROR_ARGUMENT_COUNT;
+
+  if (strcmp(argv[1], "route") == 0)
+  {
+    if (argc == 3)
+    {
+      if (find_command(argv[2]) == nullptr)
+        return ERROR_INVALID_ARGUMENT;
+      benchmark_route(argv[2]);
+    }
+    else if (argc == 2)
+    {
+      for (int i = 0; command_list[i].name != nullptr; i++)
+        benchmark_route(command_list[i].name);
+    }
+    else
+      return ERROR_ARGUMENT_COUNT;
+  }
+  else if (strcmp(argv[1], "tok") == 0)
+  {
+    // Tokens include the command name, and argv needs room for the terminating NULL
+    int token_count = argv_max - 1;
+    if (argc == 3)
+      token_count = strtoul(argv[2], NULL, 0);
+    else if (argc > 3)
+      return ERROR_ARGUMENT_COUNT;
+    if ((token_count < 1) || (token_count > argv_max - 1))
+      return ERROR_ARGUMENT_RANGE;
+
+    // This overwrites argv, so must be the last use of it
+    benchmark_tokenize(token_count);
+  }
+  else
+    return ERROR_INVALID_ARGUMENT;
+
+  return NO_ERROR;
+}
+
+/* Prints the time to look up a command name in ns, through the hash table and by a linear scan of command_list (as route() used to) */
+void CommandRouter::benchmark_route(const char *name)
+{
+  volatile uintptr_t result = 0;  // Keeps the lookups from being optimized away
+
+  uint32_t start_us = micros();
+  for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+    result += (uintptr_t)find_command(name);
+  uint32_t hash_us = micros() - start_us;
+
+  start_us = micros();
+  for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+  {
+    command_item_t *command = nullptr;
+    for (int i = 0; command_list[i].name != nullptr; i++)
+    {
+      if (strcmp(name, command_list[i].name) == 0)
+      {
+        command = &command_list[i];
+        break;
+      }
+    }
+    result += (uintptr_t)command;
+  }
+  uint32_t scan_us = micros() - start_us;
+
+  Serial.printf("BENCH.ROUTE.%s.%lu.%lu%s", name,
+                (unsigned long)((uint64_t)hash_us * 1000 / BENCHMARK_REPETITIONS),
+                (unsigned long)((uint64_t)scan_us * 1000 / BENCHMARK_REPETITIONS), SERIAL_LINE_ENDING);
+}
+
+/* Prints the time to tokenize an LED list (l.0.1.2...) with the given number of tokens in ns, using tokenize() and
+   using strtok with and without the per-token delay which dispatch_line() used to have */
+void CommandRouter::benchmark_tokenize(int token_count)
+{
+  static char line[BENCHMARK_LINE_LENGTH];
+  static char line_copy[BENCHMARK_LINE_LENGTH];
+
+  int length = sprintf(line, "l");
+  for (int token_index = 1; token_index < token_count; token_index++)
+  {
+    if (length + 8 >= BENCHMARK_LINE_LENGTH)
+    {
+      token_count = token_index;
+      break;
+    }
+    length += sprintf(line + length, ".%d", token_index - 1);
+  }
+
+  // Each pass tokenizes a fresh copy of the line, so the time taken to copy it is measured and subtracted
+  volatile int result = 0;
+  uint32_t start_us = micros();
+  for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+  {
+    memcpy(line_copy, line, length + 1);
+    result += line_copy[length / 2];
+  }
+  uint32_t copy_us = micros() - start_us;
+
+  start_us = micros();
+  for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+  {
+    memcpy(line_copy, line, length + 1);
+    result += tokenize(line_copy);
+  }
+  uint32_t tokenize_us = micros() - start_us - copy_us;
+
+  uint32_t strtok_us[2];
+  for (int delay_enabled = 0; delay_enabled < 2; delay_enabled++)
+  {
+    start_us = micros();
+    for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+    {
+      memcpy(line_copy, line, length + 1);
+      int argc = 0;
+      argv[argc] = strtok(line_copy, ".");
+      while (argv[argc] != NULL)
+      {
+        if (delay_enabled)
+          delayMicroseconds(1);
+        argv[++argc] = strtok(NULL, ".");
+      }
+      result += argc;
+    }
+    strtok_us[delay_enabled] = micros() - start_us - copy_us;
+  }
+
+  Serial.printf("BENCH.TOK.%d.%lu.%lu.%lu%s", token_count,
+                (unsigned long)((uint64_t)tokenize_us * 1000 / BENCHMARK_REPETITIONS),
+                (unsigned long)((uint64_t)strtok_us[0] * 1000 / BENCHMARK_REPETITIONS),
+                (unsigned long)((uint64_t)strtok_us[1] * 1000 / BENCHMARK_REPETITIONS), SERIAL_LINE_ENDING);
+}
@@ -37,6 +37,39 @@
 
 #define DELIMETER '.'
 
+// First byte of a binary command frame. This is outside the printable ASCII range, so it can never start a human-typed command.
+#define BINARY_FRAME_MAGIC 0xA5
+
+// Time after which a partially received binary frame is abandoned
+#define BINARY_FRAME_TIMEOUT_MS 1000
+
+// Command stream assembly states
+#define STREAM_STATE_ASCII 0
+#define STREAM_STATE_DISCARD_LINE 1
+#define STREAM_STATE_BINARY_HEADER 2
+#define STREAM_STATE_BINARY_PAYLOAD 3
+#define STREAM_STATE_DISCARD_BINARY 4
+
+// Number of complete commands which may be held for execution in pipelined mode
+#define COMMAND_QUEUE_LENGTH 32
+
+// Number of completed commands after which an acknowledgement is always sent in pipelined mode
+#define COMMAND_ACK_BATCH_SIZE 16
+
+// Queued command types
+#define COMMAND_TYPE_ASCII 0
+#define COMMAND_TYPE_BINARY 1
+#define COMMAND_TYPE_ERROR 2
+
+// Space for the arguments of binary frames forwarded to ASCII handlers, once expanded to text
+#define BINARY_TEXT_BUFFER_SIZE 256
+
+// Size of the command name hash table (must be a power of two, and larger than the number of commands)
+#define COMMAND_HASH_TABLE_SIZE 256
+
+// Space for the LED list tokenized by the bench command (enough for ARGV_MAX LED numbers)
+#define BENCHMARK_LINE_LENGTH 1536
+
 // Need to declare command router since it is used by the command_item struct;
 class CommandRouter;
 
@@ -47,27 +80,90 @@ typedef struct command_item {
   int (*func)(CommandRouter *cmd, int argc, const char **argv);
 } command_item_t;
 
+typedef struct binary_command_item {
+  uint8_t opcode;
+  const char *name;
+  int (*func)(CommandRouter *cmd, uint16_t argc, const uint16_t *argv);
+} binary_command_item_t;
+
+typedef struct command_queue_entry {
+  uint16_t id;             // Sequence number, used in acknowledgements
+  uint8_t type;            // COMMAND_TYPE_*
+  uint8_t binary_header[3];
+  int offset;              // Start of the command in the serial buffer
+  int length;              // Command length in bytes (error code for COMMAND_TYPE_ERROR)
+} command_queue_entry_t;
+
 class CommandRouter {
 public:
-  int init(command_item_t *commands, int buffer_size,
-                     char *serial_buffer, int argv_max,
-                     const char **argv_buffer);
+  int init(command_item_t *commands, binary_command_item_t *binary_commands,
+                     int buffer_size, char *serial_buffer, int argv_max,
+                     const char **argv_buffer, uint16_t *argument_value_buffer);
   int help();
   int process_serial_stream();
+  int set_pipeline_mode(bool enabled);
+  bool get_pipeline_mode();
+  bool get_argument_values(const uint16_t **values);
+  int benchmark(int argc, const char **argv);
 
   char *buffer = nullptr; // Allow for terminating null byte
   int buffer_size = 0;
 
 private:
   int route(int argc, const char **argv);
+  command_item_t *find_command(const char *name);
+  void build_command_hash_table();
+  static uint32_t hash_command_name(const char *name);
+  int route_binary(uint8_t opcode, uint16_t argc, const uint16_t *binary_argv);
+  void assemble_commands();
+  void enqueue_command(uint8_t type, int length);
+  int dispatch_next_command();
+  int tokenize(char *line);
+  int dispatch_line(char *line);
+  int dispatch_binary_frame(command_queue_entry_t *command);
+  void print_result(int result);
+  void print_acknowledgement();
+  void benchmark_route(const char *name);
+  void benchmark_tokenize(int token_count);
 
   const char **argv;
   int argv_max = 0;
 
+  // Integer values of argv[1...], filled in while tokenizing when every argument is a plain decimal number
+  uint16_t *argument_values;
+  bool argument_values_valid = false;
+
   int incoming;
 
+  // Partially assembled command, kept between calls to process_serial_stream
+  uint8_t stream_state = STREAM_STATE_ASCII;
+  int bytes_read = 0;
+  uint8_t binary_header[3];
+  size_t binary_payload_size = 0;
+  uint32_t last_byte_time_ms = 0;
+
+  // Complete commands awaiting execution. Their text or payload is stored in the serial buffer,
+  // ahead of the command currently being assembled (which starts at assembly_offset).
+  command_queue_entry_t command_queue[COMMAND_QUEUE_LENGTH];
+  int queue_head = 0;
+  int queue_count = 0;
+  int assembly_offset = 0;
+
+  // Binary frame arguments expanded to text. The serial buffer may hold queued commands, so this is kept separately.
+  char binary_text[BINARY_TEXT_BUFFER_SIZE];
+
+  // Pipelined mode state
+  bool pipeline_mode = false;
+  uint16_t next_command_id = 0;
+  uint16_t last_completed_id = 0;
+  int unacknowledged_count = 0;
+
   bool malloc_used = false;
   command_item_t *command_list;
+  binary_command_item_t *binary_command_list;
+
+  // Open-addressed hash table of command_list indicies (offset by one, zero is empty)
+  uint8_t command_hash_table[COMMAND_HASH_TABLE_SIZE];
 };
 
 extern CommandRouter cmd;
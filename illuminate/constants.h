@@ -59,6 +59,9 @@ static const char SERIAL_DELIMITER[] = ".";
 #define TRIGGER_INPUT_POLARITY_DEFAULT 1
 #define TRIGGER_OUTPUT_POLARITY_DEFAULT 1
 
+// Maximum number of trigger inputs or outputs on any device (each has its own pin interrupt and pulse timer)
+#define TRIGGER_CHANNEL_MAX 8
+
 // Misc constants
 #define MIN_SEQUENCE_DELAY 5      // Min deblur pattern delay in ms (set by hardware)
 #define MIN_SEQUENCE_DELAY_FAST 2 // Min deblur pattern delay for fast sequence in us (set by hardware)
@@ -91,8 +94,11 @@ static const char SERIAL_DELIMITER[] = ".";
 // Serial characters
 #define COMMAND_END "-==-"
 
+// Number of times each operation is repeated by the bench command
+#define BENCHMARK_REPETITIONS 1000
+
 // Error Codes
-#define ERROR_CODE_COUNT 20
+#define ERROR_CODE_COUNT 22
 
 #define NO_ERROR 0
 #define ERROR_NOT_IMPLEMENTED 1
@@ -114,5 +120,7 @@ static const char SERIAL_DELIMITER[] = ".";
 #define ERROR_MEMORY_ALLOC 17
 #define ERROR_COMMAND_TOO_LONG 18
 #define ERROR_SEQUENCE_FULL 19
+#define ERROR_BINARY_FRAME 20
+#define ERROR_SEQUENCE_RUNNING 21
 
 #endif
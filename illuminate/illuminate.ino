@@ -70,6 +70,7 @@
 #define ARGV_MAX 300
 char serial_buffer[BUFFER_SIZE];
 const char *argv_buffer[ARGV_MAX];
+uint16_t argument_value_buffer[ARGV_MAX];
 
 // Initialize objects
 LedArrayInterface led_array_interface;
@@ -82,8 +83,8 @@ void setup()
   // Initialize serial interface
   Serial.begin(SERIAL_BAUD_RATE);
 
-  cmd.init(command_list, BUFFER_SIZE, serial_buffer, ARGV_MAX,
-                     argv_buffer);
+  cmd.init(command_list, binary_command_list, BUFFER_SIZE, serial_buffer, ARGV_MAX,
+                     argv_buffer, argument_value_buffer);
 
   // Initialize LED Array
   led_array.set_interface(&led_array_interface);
@@ -97,9 +98,9 @@ void setup()
 // This command runs continuously after setup() runs once
 void loop()
 {
-  // Loop until we recieve a command, then parse it.
-  if (Serial.available())
-    cmd.process_serial_stream();
+  // Assemble any serial input which has arrived, dispatching commands once they are complete.
+  // This returns immediately if no command is ready.
+  cmd.process_serial_stream();
 }
 
 int info_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.print_about(argc, (char * *) argv);}
@@ -121,7 +122,22 @@ int brightness_func(CommandRouter *cmd, int argc, const char **argv){ return led
 int array_distance_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.set_array_distance(argc, (char * *) argv); }
 int cosine_func(CommandRouter *cmd, int argc, const char **argv) { return led_array.set_cosine_factor(argc, (char * *) argv); }
 
-int set_led_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.draw_led_list(argc, (char * *)argv); }
+int set_led_func(CommandRouter *cmd, int argc, const char **argv)
+{
+  // Use the LED indicies parsed by the tokenizer where possible
+  const uint16_t *led_list;
+  if ((argc > 1) && cmd->get_argument_values(&led_list))
+    return led_array.draw_led_list(argc - 1, led_list);
+  return led_array.draw_led_list(argc, (char * *)argv);
+}
+int set_led_bitmask_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.draw_led_bitmask(argc, (char * *)argv); }
+int set_led_frame_func(CommandRouter *cmd, int argc, const char **argv)
+{
+  const uint16_t *led_values;
+  if (!cmd->get_argument_values(&led_values))
+    return ERROR_INVALID_ARGUMENT;
+  return led_array.draw_led_frame(argc - 1, led_values);
+}
 
 int clear_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.clear(); }
 int fill_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.fill_array(); }
@@ -139,8 +155,16 @@ int scan_brightfield_func(CommandRouter *cmd, int argc, const char **argv){ retu
 int scan_darkfield_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.run_sequence_individual_darkfield_leds(argc, (char * *) argv); }
 
 int set_custom_sequence_length_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.set_custom_sequence_length(argc, (char * *) argv); }
-int set_custom_sequence_value_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.set_custom_sequence_value(argc, (char * *) argv); }
+int set_custom_sequence_value_func(CommandRouter *cmd, int argc, const char **argv)
+{
+  // Use the LED indicies parsed by the tokenizer where possible
+  const uint16_t *led_list;
+  if ((argc > 1) && cmd->get_argument_values(&led_list))
+    return led_array.set_custom_sequence_value(argc - 1, led_list);
+  return led_array.set_custom_sequence_value(argc, (char * *) argv);
+}
 int run_sequence_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.run_custom_sequence(argc, (char * *) argv); }
+int run_sequence_timed_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.run_custom_sequence_timed(argc, (char * *) argv); }
 int print_custom_sequence_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.print_custom_sequence(argc, (char * *) argv); }
 int step_sequence_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.step_custom_sequence(argc, (char * *) argv); }
 int restart_sequence_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.restart_custom_sequence(argc, (char * *) argv); }
@@ -186,6 +210,33 @@ int trigger_output_polarity_func(CommandRouter *cmd, int argc, const char **argv
 int trigger_output_delay_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.set_trigger_output_delay(argc, (char * *) argv); }
 int trigger_input_pin_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.get_trigger_input_pins(argc, (char * *) argv); }
 int trigger_output_pin_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.get_trigger_output_pins(argc, (char * *) argv); }
+int trigger_latency_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.print_trigger_latency(argc, (char * *) argv); }
+int trigger_trace_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.print_trigger_trace(argc, (char * *) argv); }
+int strobe_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.set_strobe_input(argc, (char * *) argv); }
 int global_shutter_func(CommandRouter *cmd, int argc, const char **argv){ return led_array.set_global_shutter_state(argc, (char * *) argv); }
 
 int hw_initialize_function(CommandRouter *cmd, int argc, const char **argv){ return led_array.initialize_hardware(argc, (char * *) argv); }
+
+int pipeline_func(CommandRouter *cmd, int argc, const char **argv)
+{
+  if (argc == 2)
+    cmd->set_pipeline_mode((bool)atoi(argv[1]));
+  else if (argc != 1)
+    return ERROR_ARGUMENT_COUNT;
+
+  Serial.printf("PIPE.%d%s", cmd->get_pipeline_mode(), SERIAL_LINE_ENDING);
+  return NO_ERROR;
+}
+
+int benchmark_func(CommandRouter *cmd, int argc, const char **argv)
+{
+  // Command processing is timed by the command router, and drawing by the LED array
+  if ((argc >= 2) && ((strcmp(argv[1], "route") == 0) || (strcmp(argv[1], "tok") == 0)))
+    return cmd->benchmark(argc, argv);
+  return led_array.benchmark(argc, (char * *) argv);
+}
+
+int set_led_binary_func(CommandRouter *cmd, uint16_t argc, const uint16_t *argv){ return led_array.draw_led_list(argc, argv); }
+int set_led_bitmask_binary_func(CommandRouter *cmd, uint16_t argc, const uint16_t *argv){ return led_array.draw_led_bitmask((const uint8_t *)argv, argc * sizeof(uint16_t)); }
+int set_led_frame_binary_func(CommandRouter *cmd, uint16_t argc, const uint16_t *argv){ return led_array.draw_led_frame(argc, argv); }
+int set_custom_sequence_value_binary_func(CommandRouter *cmd, uint16_t argc, const uint16_t *argv){ return led_array.set_custom_sequence_value(argc, argv); }
@@ -29,6 +29,9 @@
 
 #include "ledarray.h"
 #include "illuminate.h"
+#include "triggeredges.h"
+#include "triggerpulses.h"
+#include "tlc5955dma.h"
 
 volatile uint16_t LedArray::pattern_index = 0;
 
@@ -40,6 +43,23 @@ volatile int * LedArray::trigger_output_mode_list;
 volatile bool * LedArray::trigger_input_polarity_list;
 volatile bool * LedArray::trigger_output_polarity_list;
 LedSequence LedArray::led_sequence;
+LED_SEQUENCE_MEMORY uint16_t LedSequence::led_pool[LED_SEQUENCE_MAX_LEDS];
+LED_SEQUENCE_MEMORY uint32_t LedSequence::pattern_offsets[LED_SEQUENCE_MAX_PATTERNS + 1];
+LED_SEQUENCE_MEMORY uint16_t LedSequence::compiled_grayscale_indices[LED_SEQUENCE_MAX_COMPILED_VALUES];
+LED_SEQUENCE_MEMORY uint16_t LedSequence::compiled_values[LED_SEQUENCE_MAX_COMPILED_VALUES];
+LED_SEQUENCE_MEMORY uint16_t LedSequence::compiled_offsets[LED_SEQUENCE_MAX_PATTERNS + 1];
+
+IntervalTimer LedArray::sequence_timer;
+LedArray * LedArray::timed_sequence_instance = NULL;
+volatile bool LedArray::timed_sequence_running = false;
+volatile uint16_t LedArray::timed_sequence_pattern_index = 0;
+volatile uint16_t LedArray::timed_sequence_run_index = 0;
+volatile uint16_t LedArray::timed_sequence_run_count = 0;
+volatile uint32_t LedArray::timed_sequence_trigger_mask = 0;
+volatile uint32_t LedArray::timed_sequence_overrun_count = 0;
+
+// Copy of the trigger trace, taken so it can be printed while new events are recorded
+static trigger_trace_entry_t trigger_trace_snapshot[TRIGGER_TRACE_LENGTH];
 
 uint8_t LedArray::get_device_command_count()
 {
@@ -75,7 +95,7 @@ int LedArray::device_command(int device_command_index, uint16_t argc, char * *ar
   }
 
   if (auto_clear_flag)
-    led_array_interface->clear();
+    led_array_interface->clear_frame();
 
   if (pattern_number < 0)
   {
@@ -408,6 +428,9 @@ int LedArray::print_mac_address()
 
 int LedArray::set_demo_mode(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   if (argc == 1)
     set_demo_mode(true);
   else if (argc == 2)
@@ -455,6 +478,9 @@ int LedArray::print_part_number(uint16_t argc, char ** argv)
 /* A function to reset the device to power-on state */
 int LedArray::reset(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   // Print current SN
   clear_output_buffers();
   sprintf(output_buffer_short, "RESET");
@@ -467,6 +493,9 @@ int LedArray::reset(uint16_t argc, char ** argv)
 /* A function to draw a random "disco" pattern. For parties, mostly. */
 int LedArray::disco()
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   // Determine number of LEDs to illuminate at once
   int led_on_count = (int)round(led_array_interface->led_count / 4.0);
 
@@ -480,7 +509,7 @@ int LedArray::disco()
   // Party time
   while (Serial.available() == 0)
   {
-    led_array_interface->clear();
+    led_array_interface->clear_frame();
 
     for (uint16_t led_index = 0; led_index < led_on_count; led_index++)
     {
@@ -501,6 +530,9 @@ int LedArray::disco()
 /* A function to draw a water drop (radial sine pattern)*/
 int LedArray::water_drop()
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   // Clear the array
   clear();
 
@@ -523,7 +555,7 @@ int LedArray::water_drop()
     set_led(-1, -1, false);
     for (uint16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
     {
-      na = sqrt(LedArrayInterface::led_position_list_na[led_index][0] * LedArrayInterface::led_position_list_na[led_index][0] + LedArrayInterface::led_position_list_na[led_index][1] * LedArrayInterface::led_position_list_na[led_index][1]);
+      na = LedArrayInterface::led_position_list_na_radius[led_index];
       value = (uint8_t)round(0.5 * (1.0 + sin(((na / na_period) + ((float)phase_counter / 100.0)) * 2.0 * 3.14)) * max_led_value);
       for (int color_channel_index = 0; color_channel_index <  led_array_interface->color_channel_count; color_channel_index++)
         set_led(led_index, color_channel_index, value);
@@ -542,48 +574,122 @@ int LedArray::water_drop()
 }
 
 
+/* Orders LED indicies by radial NA (then by index), for building led_na_sorted_list */
+static int compare_led_na(const void * a, const void * b)
+{
+  uint16_t led_a = *(const uint16_t *)a;
+  uint16_t led_b = *(const uint16_t *)b;
+  float na_a = LedArrayInterface::led_position_list_na_radius[led_a];
+  float na_b = LedArrayInterface::led_position_list_na_radius[led_b];
+
+  if (na_a != na_b)
+    return (na_a < na_b) ? -1 : 1;
+  return (int)led_a - (int)led_b;
+}
+
+/* Returns the first position in led_na_sorted_list with a radial NA above na (or equal to it, if include_equal is set) */
+uint16_t LedArray::find_na_index(float na, bool include_equal)
+{
+  uint16_t low = 0;
+  uint16_t high = led_array_interface->led_count;
+  while (low < high)
+  {
+    uint16_t middle = (low + high) / 2;
+    float middle_na = LedArrayInterface::led_position_list_na_radius[LedArrayInterface::led_na_sorted_list[middle]];
+    if ((middle_na < na) || (!include_equal && (middle_na == na)))
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
 /* A function to calculate the NA of each LED given the XYZ position and an offset */
 void LedArray::build_na_list(float new_board_distance)
 {
-  float Na_x, Na_y, yz, xz, x, y, z, z0;
+  float Na_x, Na_y, x, y, z, r;
 
   if (new_board_distance > 0)
     led_array_distance_z = new_board_distance;
 
+  // z position of center LED
+  float z0 = float((int16_t) pgm_read_word(&(LedArrayInterface::led_positions[0][4]))) / 100.0;
+
   max_na = 0;
   for ( int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
   {
-    if ((int16_t)pgm_read_word(&(LedArrayInterface::led_positions[led_index][1])) >= 0)
+    if (LedArrayInterface::led_channel_list[led_index] >= 0)
     {
       x =  float((int16_t) pgm_read_word(&(LedArrayInterface::led_positions[led_index][2]))) / 100.0;
       y =  float((int16_t) pgm_read_word(&(LedArrayInterface::led_positions[led_index][3]))) / 100.0;
-      z0 = float((int16_t) pgm_read_word(&(LedArrayInterface::led_positions[0][4]))) / 100.0; // z position of center LED
       z =  float((int16_t) pgm_read_word(&(LedArrayInterface::led_positions[led_index][4]))) / 100.0 - z0 + led_array_distance_z;
 
-      yz = sqrt(y * y + z * z);
-      xz = sqrt(x * x + z * z);
-      Na_x = sin(atan(x / yz));
-      Na_y = sin(atan(y / xz));
+      // sin(atan(x / sqrt(y^2 + z^2))) simplifies to x / sqrt(x^2 + y^2 + z^2), so no trigonometry is needed
+      r = sqrt(x * x + y * y + z * z);
+      Na_x = x / r;
+      Na_y = y / r;
 
       LedArrayInterface::led_position_list_na[led_index][0] = Na_x;
       LedArrayInterface::led_position_list_na[led_index][1] = Na_y;
-
-      // Calculate max NA
-      max_na = max(max_na, sqrt(Na_x * Na_x + Na_y * Na_y));
     }
     else
     {
       LedArrayInterface::led_position_list_na[led_index][0] = INVALID_NA; // invalid NA
       LedArrayInterface::led_position_list_na[led_index][1] = INVALID_NA; // invalid NA
     }
+
+    // Radial NA, so that drawing functions don't need to compute it for each LED
+    LedArrayInterface::led_position_list_na_radius[led_index] = sqrt(LedArrayInterface::led_position_list_na[led_index][0] * LedArrayInterface::led_position_list_na[led_index][0]
+                                                                     + LedArrayInterface::led_position_list_na[led_index][1] * LedArrayInterface::led_position_list_na[led_index][1]);
+
+    // Calculate max NA
+    if (LedArrayInterface::led_channel_list[led_index] >= 0)
+      max_na = max(max_na, LedArrayInterface::led_position_list_na_radius[led_index]);
   }
+
+  // Sort LEDs by radial NA, so NA ranges can be found with a binary search
+  for (int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
+    LedArrayInterface::led_na_sorted_list[led_index] = led_index;
+  qsort(LedArrayInterface::led_na_sorted_list, led_array_interface->led_count, sizeof(uint16_t), compare_led_na);
+
+  // Cosine gains depend on the LED positions
+  build_cosine_gain_list();
+
+  // Cached patterns were computed from the previous positions
+  invalidate_pattern_cache();
+
   if (debug_level)
     Serial.printf(F("Finished updating led positions."));
 }
 
+/* A function to compute the cosine weighting gain of each LED, (1 / cos(asin(NA)))^cosine_factor, in Q16 fixed point */
+void LedArray::build_cosine_gain_list()
+{
+  if (cosine_factor == 0)
+    return;
+
+  for (int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
+  {
+    float na = LedArrayInterface::led_position_list_na_radius[led_index];
+    if (na >= 1.0)
+    {
+      // Invalid LED positions are not weighted
+      LedArrayInterface::led_cosine_gain_list[led_index] = COSINE_GAIN_UNITY;
+      continue;
+    }
+
+    // 1 / cos(asin(na)) is 1 / sqrt(1 - na^2)
+    float gain = pow(1.0 / sqrt(1.0 - na * na), cosine_factor) * COSINE_GAIN_UNITY;
+    LedArrayInterface::led_cosine_gain_list[led_index] = (gain < (float)UINT32_MAX) ? (uint32_t)gain : UINT32_MAX;
+  }
+}
+
 /* A function to fill the LED array with the color specified by led_value */
 int LedArray::fill_array()
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   // Turn on all LEDs
   for ( int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
   {
@@ -603,8 +709,11 @@ int LedArray::fill_array()
 /* A function to clear the LED array */
 int LedArray::clear()
 {
+  // Drawing and sequence commands would write the driver buffer, sequence and SPI bus used by timed playback
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   led_array_interface->clear();
-  led_array_interface->update();
   return NO_ERROR;
 }
 
@@ -671,7 +780,10 @@ int LedArray::set_cosine_factor(uint16_t argc, char ** argv)
   if (argc == 1)
     ; // do nothing, just display current na
   else if (argc == 2)
+  {
     cosine_factor = (uint8_t)atoi(argv[1]);
+    build_cosine_gain_list();
+  }
   else
     return ERROR_ARGUMENT_COUNT;
 
@@ -686,8 +798,11 @@ int LedArray::set_cosine_factor(uint16_t argc, char ** argv)
 /* A function to draw a darkfield pattern */
 int LedArray::draw_darkfield(uint16_t argc, char * *argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   if (auto_clear_flag)
-    clear();
+    led_array_interface->clear_frame();
 
   draw_primative_circle(objective_na, 1.0);
   led_array_interface->update();
@@ -698,6 +813,9 @@ int LedArray::draw_darkfield(uint16_t argc, char * *argv)
 /* A function to draw a cDPC pattern */
 int LedArray::draw_cdpc(uint16_t argc, char * *argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   if (led_array_interface->color_channel_count != 3)
   {
     return ERROR_NOT_SUPPORTED_BY_DEVICE;
@@ -725,7 +843,7 @@ int LedArray::draw_cdpc(uint16_t argc, char * *argv)
 
     // Clear array
     if (auto_clear_flag)
-      clear();
+      led_array_interface->clear_frame();
 
     for (int quadrant_index = 0; quadrant_index < 4; quadrant_index++)
     {
@@ -736,7 +854,7 @@ int LedArray::draw_cdpc(uint16_t argc, char * *argv)
       {
         if (cdpc_mask[quadrant_index][color_index])
         {
-          led_value[color_index] = illumination_intensity;
+          led_value[color_index] = illumination_intensity * UINT8_TO_UINT16_SCALE;
           draw_primative_quadrant(quadrant_index, inner_na, objective_na, true);
         }
       }
@@ -749,6 +867,9 @@ int LedArray::draw_cdpc(uint16_t argc, char * *argv)
 /* A function to draw a half annulus */
 int LedArray::draw_half_annulus(uint16_t argc, char * *argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   float na_start = objective_na;
   float na_end = objective_na + 0.2;
   int8_t pattern_index = -1;
@@ -793,7 +914,7 @@ int LedArray::draw_half_annulus(uint16_t argc, char * *argv)
   }
 
   if (auto_clear_flag)
-    clear();
+    led_array_interface->clear_frame();
 
   if (pattern_index >= 0)
   {
@@ -812,6 +933,9 @@ int LedArray::draw_half_annulus(uint16_t argc, char * *argv)
 /* A function to draw a color darkfield pattern */
 int LedArray::draw_color_darkfield(uint16_t argc, char * * argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   if (led_array_interface->color_channel_count != 3)
   {
     return ERROR_NOT_IMPLEMENTED;
@@ -850,7 +974,7 @@ int LedArray::draw_color_darkfield(uint16_t argc, char * * argv)
     };
 
     // Clear array
-    led_array_interface->clear();
+    led_array_interface->clear_frame();
     for (int quadrant_index = 0; quadrant_index < 4; quadrant_index++)
     {
       // Set all colors to zero (off)
@@ -860,7 +984,7 @@ int LedArray::draw_color_darkfield(uint16_t argc, char * * argv)
       {
         if (cdf_mask[quadrant_index][color_index])
         {
-          led_value[color_index] = illumination_intensity;
+          led_value[color_index] = illumination_intensity * UINT8_TO_UINT16_SCALE;
           draw_primative_quadrant(quadrant_index, start_na, end_na, true);
         }
       }
@@ -874,6 +998,9 @@ int LedArray::draw_color_darkfield(uint16_t argc, char * * argv)
 /* A function to draw an annulus*/
 int LedArray::draw_annulus(uint16_t argc, char * * argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   float start_na, end_na;
   if (argc == 1)
   {
@@ -900,7 +1027,7 @@ int LedArray::draw_annulus(uint16_t argc, char * * argv)
   }
 
   if (auto_clear_flag)
-    clear();
+    led_array_interface->clear_frame();
 
   // Draw circle
   draw_primative_circle(start_na, end_na);
@@ -912,10 +1039,13 @@ int LedArray::draw_annulus(uint16_t argc, char * * argv)
 /* A function to draw a spoecific LED channel as indexed in hardware */
 int LedArray::draw_channel(uint16_t argc, char * *argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   if (argc == 2)
   {
     if (auto_clear_flag)
-      clear();
+      led_array_interface->clear_frame();
 
     for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
       led_array_interface->set_channel(strtol(argv[1], NULL, 0), color_channel_index, led_value[color_channel_index]);
@@ -930,6 +1060,9 @@ int LedArray::draw_channel(uint16_t argc, char * *argv)
 /* A function to set the pin order of a LED (for multi-color designs */
 int LedArray::set_pin_order(uint16_t argc, char * *argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   if (argc == led_array_interface->color_channel_count)
     for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
       led_array_interface->set_pin_order(-1, color_channel_index, strtoul(argv[color_channel_index], NULL, 0));
@@ -946,6 +1079,8 @@ int LedArray::set_global_shutter_state(uint16_t argc, char ** argv)
 {
   if (argc == 2)
   {
+    if (timed_sequence_running)
+      return ERROR_SEQUENCE_RUNNING;
     led_array_interface->set_global_shutter_state(bool(atoi(argv[1])));
   }
   else if (argc == 1)
@@ -970,7 +1105,10 @@ int LedArray::set_trigger_input_timeout(uint16_t argc, char ** argv)
   {
     uint16_t new_trigger_timeout_seconds = strtoul(argv[1], NULL, 0);
     if (new_trigger_timeout_seconds > 0)
+    {
       LedArray::trigger_input_timeout = (float)new_trigger_timeout_seconds;
+      Tlc5955Dma::set_strobe_timeout((uint32_t)new_trigger_timeout_seconds * 1000);
+    }
   }
   else if (argc > 1)
     return ERROR_ARGUMENT_COUNT;
@@ -984,293 +1122,170 @@ int LedArray::set_trigger_input_timeout(uint16_t argc, char ** argv)
   return NO_ERROR;
 }
 
-int LedArray::set_trigger_output_pulse_width(uint16_t argc, char ** argv)
+/* Prints one value for each trigger channel, as NAME.a.b.c (short) and "<description> is (a, b, c)." (long) */
+template <typename T>
+void LedArray::print_trigger_list(const char * command_name, const char * description, const volatile T * values, int trigger_count)
 {
-
-  if ((argc == 2) && (led_array_interface->trigger_output_count == 1))
-  {
-    uint16_t new_trigger_pulse_width_us = strtoul(argv[1], NULL, 0);
-    if (new_trigger_pulse_width_us > 0)
-      LedArray::trigger_output_pulse_width_list_us[0] = new_trigger_pulse_width_us;
-  }
-  else if (argc == 3)
-  {
-    uint8_t trigger_index = atoi(argv[1]);
-    uint16_t new_trigger_pulse_width_us = strtoul(argv[2], NULL, 0);
-    if (new_trigger_pulse_width_us > 0)
-      LedArray::trigger_output_pulse_width_list_us[trigger_index] = new_trigger_pulse_width_us;
-  }
-  else if (argc > 2)
-    return ERROR_ARGUMENT_COUNT;
-
-  // Print current pulse width
-  if (led_array_interface->trigger_output_count == 1)
+  clear_output_buffers();
+  if (trigger_count == 0)
   {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TROUTPUTPULSEWIDTH.%lu", LedArray::trigger_output_pulse_width_list_us[0]);
-    sprintf(output_buffer_long, "Current trigger output pulse width is %lu microseconds.", LedArray::trigger_output_pulse_width_list_us[0]);
+    sprintf(output_buffer_short, "%s.NONE", command_name);
+    sprintf(output_buffer_long, "%s: none on this device.", description);
     print(output_buffer_short, output_buffer_long);
+    return;
   }
-  else if (led_array_interface->trigger_output_count == 2)
+
+  int short_length = snprintf(output_buffer_short, MAX_RESPONSE_LENGTH_SHORT, "%s", command_name);
+  int long_length = snprintf(output_buffer_long, MAX_RESPONSE_LENGTH_LONG, (trigger_count == 1) ? "%s is " : "%s is (", description);
+  for (int trigger_index = 0; trigger_index < trigger_count; trigger_index++)
   {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TROUTPUTPULSEWIDTH.%lu.%lu", LedArray::trigger_output_pulse_width_list_us[0], LedArray::trigger_output_pulse_width_list_us[1]);
-    sprintf(output_buffer_long, "Current trigger output pulse widths are (%lu, %lu) microseconds.", LedArray::trigger_output_pulse_width_list_us[0], LedArray::trigger_output_pulse_width_list_us[1]);
-    print(output_buffer_short, output_buffer_long);
+    if (short_length < MAX_RESPONSE_LENGTH_SHORT)
+      short_length += snprintf(output_buffer_short + short_length, MAX_RESPONSE_LENGTH_SHORT - short_length, ".%ld", (long)values[trigger_index]);
+    if (long_length < MAX_RESPONSE_LENGTH_LONG)
+      long_length += snprintf(output_buffer_long + long_length, MAX_RESPONSE_LENGTH_LONG - long_length, (trigger_index > 0) ? ", %ld" : "%ld", (long)values[trigger_index]);
   }
-  else
-    return ERROR_NOT_IMPLEMENTED;
+  if (long_length < MAX_RESPONSE_LENGTH_LONG)
+    snprintf(output_buffer_long + long_length, MAX_RESPONSE_LENGTH_LONG - long_length, (trigger_count == 1) ? "." : ").");
 
-  return NO_ERROR;
+  print(output_buffer_short, output_buffer_long);
 }
 
-int LedArray::set_trigger_input_mode(uint16_t argc, char ** argv)
+/* Parses the trigger index for commands of the form command.[value] (single-channel devices) or command.[index].[value].
+   Returns the index of the value argument, zero if there is nothing to set, or a negative error code. */
+int LedArray::parse_trigger_index(uint16_t argc, char ** argv, int trigger_count, int * trigger_index)
 {
-  if ((argc == 2) && (led_array_interface->trigger_input_count == 1))
+  if ((argc == 2) && (trigger_count == 1))
   {
-    LedArray::trigger_input_mode_list[0] = (int)atoi(argv[1]);
+    *trigger_index = 0;
+    return 1;
   }
   else if (argc == 3)
   {
-    uint8_t trigger_index = atoi(argv[1]);
-    LedArray::trigger_input_mode_list[trigger_index] = (int)atoi(argv[2]);
+    *trigger_index = atoi(argv[1]);
+    if ((*trigger_index < 0) || (*trigger_index >= trigger_count))
+      return ERROR_INVALID_ARGUMENT;
+    return 2;
   }
   else if (argc > 2)
     return ERROR_ARGUMENT_COUNT;
 
-  // Print current mode
-  if (led_array_interface->trigger_input_count == 1)
-  {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TRINPUTMODE.%d", LedArray::trigger_input_mode_list[0]);
-    sprintf(output_buffer_long, "Current trigger input mode is %d.", LedArray::trigger_input_mode_list[0]);
-    print(output_buffer_short, output_buffer_long);
-  }
-  else if (led_array_interface->trigger_input_count == 2)
+  return 0;
+}
+
+int LedArray::set_trigger_output_pulse_width(uint16_t argc, char ** argv)
+{
+  int trigger_index;
+  int value_index = parse_trigger_index(argc, argv, led_array_interface->trigger_output_count, &trigger_index);
+  if (value_index < 0)
+    return value_index;
+  else if (value_index > 0)
   {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TRINPUTPOLARITY.%d.%d", LedArray::trigger_input_mode_list[0], LedArray::trigger_input_mode_list[1]);
-    sprintf(output_buffer_long, "Current trigger input mode is (%d, %d).", LedArray::trigger_input_mode_list[0], LedArray::trigger_input_mode_list[1]);
-    print(output_buffer_short, output_buffer_long);
+    uint32_t new_trigger_pulse_width_us = strtoul(argv[value_index], NULL, 0);
+    if (new_trigger_pulse_width_us > 0)
+      LedArray::trigger_output_pulse_width_list_us[trigger_index] = new_trigger_pulse_width_us;
   }
-  else
-    return ERROR_NOT_IMPLEMENTED;
 
-  return NO_ERROR;
+  // Print current pulse width
+  print_trigger_list("TROUTPUTPULSEWIDTH", "Current trigger output pulse width (us)", LedArray::trigger_output_pulse_width_list_us, led_array_interface->trigger_output_count);
 
+  return NO_ERROR;
 }
 
-int LedArray::set_trigger_output_mode(uint16_t argc, char ** argv)
+int LedArray::set_trigger_input_mode(uint16_t argc, char ** argv)
 {
-  if ((argc == 2) && (led_array_interface->trigger_output_count == 1))
+  int trigger_index;
+  int value_index = parse_trigger_index(argc, argv, led_array_interface->trigger_input_count, &trigger_index);
+  if (value_index < 0)
+    return value_index;
+  else if (value_index > 0)
   {
-    LedArray::trigger_output_mode_list[0] = (int)atoi(argv[1]);
+    LedArray::trigger_input_mode_list[trigger_index] = (int)atoi(argv[value_index]);
+    update_trigger_input_interrupts();
   }
-  else if (argc == 3)
-  {
-    uint8_t trigger_index = atoi(argv[1]);
-    LedArray::trigger_output_mode_list[trigger_index] = (int)atoi(argv[2]);
-  }
-  else if (argc > 2)
-    return ERROR_ARGUMENT_COUNT;
 
   // Print current mode
-  if (led_array_interface->trigger_output_count == 1)
-  {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TROUTPUTMODE.%d", LedArray::trigger_output_mode_list[0]);
-    sprintf(output_buffer_long, "Current trigger output mode is %d.", LedArray::trigger_output_mode_list[0]);
-    print(output_buffer_short, output_buffer_long);
-  }
-  else if (led_array_interface->trigger_output_count == 2)
-  {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TROUTPUTPOLARITY.%d.%d", LedArray::trigger_input_mode_list[0], LedArray::trigger_output_mode_list[1]);
-    sprintf(output_buffer_long, "Current trigger output mode is (%d, %d).", LedArray::trigger_input_mode_list[0], LedArray::trigger_output_mode_list[1]);
-    print(output_buffer_short, output_buffer_long);
-  }
-  else
-    return ERROR_NOT_IMPLEMENTED;
+  print_trigger_list("TRINPUTMODE", "Current trigger input mode", LedArray::trigger_input_mode_list, led_array_interface->trigger_input_count);
 
   return NO_ERROR;
+}
+
+int LedArray::set_trigger_output_mode(uint16_t argc, char ** argv)
+{
+  int trigger_index;
+  int value_index = parse_trigger_index(argc, argv, led_array_interface->trigger_output_count, &trigger_index);
+  if (value_index < 0)
+    return value_index;
+  else if (value_index > 0)
+    LedArray::trigger_output_mode_list[trigger_index] = (int)atoi(argv[value_index]);
+
+  // Print current mode
+  print_trigger_list("TROUTPUTMODE", "Current trigger output mode", LedArray::trigger_output_mode_list, led_array_interface->trigger_output_count);
 
+  return NO_ERROR;
 }
 
 int LedArray::set_trigger_input_polarity(uint16_t argc, char ** argv)
 {
-  if ((argc == 2) && (led_array_interface->trigger_input_count == 1))
-  {
-    LedArray::trigger_input_polarity_list[0] = (bool)atoi(argv[1]);
-  }
-  else if (argc == 3)
-  {
-    uint8_t trigger_index = atoi(argv[1]);
-    LedArray::trigger_input_polarity_list[trigger_index] = (bool)atoi(argv[2]);
-  }
-  else if (argc > 2)
-    return ERROR_ARGUMENT_COUNT;
+  int trigger_index;
+  int value_index = parse_trigger_index(argc, argv, led_array_interface->trigger_input_count, &trigger_index);
+  if (value_index < 0)
+    return value_index;
+  else if (value_index > 0)
+    LedArray::trigger_input_polarity_list[trigger_index] = (bool)atoi(argv[value_index]);
 
   // Print current polarity
-  if (led_array_interface->trigger_input_count == 1)
-  {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TRINPUTPOLARITY.%d", LedArray::trigger_input_polarity_list[0]);
-    sprintf(output_buffer_long, "Current trigger input polarity is %d.", LedArray::trigger_input_polarity_list[0]);
-    print(output_buffer_short, output_buffer_long);
-  }
-  else if (led_array_interface->trigger_input_count == 2)
-  {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TRINPUTPOLARITY.%d.%d", LedArray::trigger_input_polarity_list[0], LedArray::trigger_input_polarity_list[1]);
-    sprintf(output_buffer_long, "Current trigger input polarity is (%d, %d).", LedArray::trigger_input_polarity_list[0], LedArray::trigger_input_polarity_list[1]);
-    print(output_buffer_short, output_buffer_long);
-  }
-  else
-    return ERROR_NOT_IMPLEMENTED;
+  print_trigger_list("TRINPUTPOLARITY", "Current trigger input polarity", LedArray::trigger_input_polarity_list, led_array_interface->trigger_input_count);
 
   return NO_ERROR;
-
 }
 
 int LedArray::set_trigger_output_polarity(uint16_t argc, char ** argv)
 {
-  if ((argc == 2) && (led_array_interface->trigger_output_count == 1))
-  {
-    LedArray::trigger_output_polarity_list[0] = (bool)atoi(argv[1]);
-  }
-  else if (argc == 3)
-  {
-    uint8_t trigger_index = atoi(argv[1]);
-    LedArray::trigger_output_polarity_list[trigger_index] = (bool)atoi(argv[2]);
-  }
-  else if (argc > 2)
-    return ERROR_ARGUMENT_COUNT;
+  int trigger_index;
+  int value_index = parse_trigger_index(argc, argv, led_array_interface->trigger_output_count, &trigger_index);
+  if (value_index < 0)
+    return value_index;
+  else if (value_index > 0)
+    LedArray::trigger_output_polarity_list[trigger_index] = (bool)atoi(argv[value_index]);
 
   // Print current polarity
-  if (led_array_interface->trigger_output_count == 1)
-  {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TROUTPUTPOLARITY.%d", LedArray::trigger_output_polarity_list[0]);
-    sprintf(output_buffer_long, "Current trigger output polarity is %d.", LedArray::trigger_output_polarity_list[0]);
-    print(output_buffer_short, output_buffer_long);
-  }
-  else if (led_array_interface->trigger_output_count == 2)
-  {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TROUTPUTPOLARITY.%d.%d", LedArray::trigger_output_polarity_list[0], LedArray::trigger_output_polarity_list[1]);
-    sprintf(output_buffer_long, "Current trigger output polarity is (%d, %d).", LedArray::trigger_output_polarity_list[0], LedArray::trigger_output_polarity_list[1]);
-    print(output_buffer_short, output_buffer_long);
-  }
-  else
-    return ERROR_NOT_IMPLEMENTED;
+  print_trigger_list("TROUTPUTPOLARITY", "Current trigger output polarity", LedArray::trigger_output_polarity_list, led_array_interface->trigger_output_count);
 
   return NO_ERROR;
 }
 
 int LedArray::set_trigger_output_delay(uint16_t argc, char ** argv)
 {
-  if ((argc == 2) && (led_array_interface->trigger_output_count == 1))
-  {
-    uint16_t new_trigger_delay_us = strtoul(argv[1], NULL, 0);
-    if (new_trigger_delay_us >= 0)
-      LedArray::trigger_output_start_delay_list_us[0] = new_trigger_delay_us;
-  }
-  else if (argc == 3)
-  {
-    uint8_t trigger_index = atoi(argv[1]);
-    uint16_t new_trigger_delay_us = strtoul(argv[2], NULL, 0);
-    if (new_trigger_delay_us >= 0)
-      LedArray::trigger_output_start_delay_list_us[trigger_index] = new_trigger_delay_us;
-  }
-  else if (argc > 2)
-    return ERROR_ARGUMENT_COUNT;
+  int trigger_index;
+  int value_index = parse_trigger_index(argc, argv, led_array_interface->trigger_output_count, &trigger_index);
+  if (value_index < 0)
+    return value_index;
+  else if (value_index > 0)
+    LedArray::trigger_output_start_delay_list_us[trigger_index] = strtoul(argv[value_index], NULL, 0);
 
-  // Print current polarity
-  if (led_array_interface->trigger_output_count == 1)
-  {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TROUTPUTDELAY.%lu", LedArray::trigger_output_start_delay_list_us[0]);
-    sprintf(output_buffer_long, "Current trigger output delay is %lu.", LedArray::trigger_output_start_delay_list_us[0]);
-    print(output_buffer_short, output_buffer_long);
-  }
-  else if (led_array_interface->trigger_output_count == 2)
-  {
-    clear_output_buffers();
-    sprintf(output_buffer_short, "TROUTPUTDELAY.%lu.%lu", LedArray::trigger_output_start_delay_list_us[0], LedArray::trigger_output_start_delay_list_us[1]);
-    sprintf(output_buffer_long, "Current trigger output delay is (%lu, %lu).", LedArray::trigger_output_start_delay_list_us[0], LedArray::trigger_output_start_delay_list_us[1]);
-    print(output_buffer_short, output_buffer_long);
-  }
-  else
-    return ERROR_NOT_IMPLEMENTED;
+  // Print current delay
+  print_trigger_list("TROUTPUTDELAY", "Current trigger output delay (us)", LedArray::trigger_output_start_delay_list_us, led_array_interface->trigger_output_count);
 
   return NO_ERROR;
 }
 
 int LedArray::get_trigger_input_pins(uint16_t argc, char ** argv)
 {
-  if (argc == 1)
-  {
-    if (led_array_interface->trigger_input_count == 0)
-    {
-      clear_output_buffers();
-      sprintf(output_buffer_short, "TRINPUTPIN.NONE");
-      sprintf(output_buffer_long, "No trigger input pins on this device.");
-      print(output_buffer_short, output_buffer_long);
-    }
-    else if (led_array_interface->trigger_input_count == 1)
-    {
-      clear_output_buffers();
-      sprintf(output_buffer_short, "TRINPUTPIN.%d", led_array_interface->trigger_input_pin_list[0]);
-      sprintf(output_buffer_long, "Trigger input pin is %d", led_array_interface->trigger_input_pin_list[0]);
-      print(output_buffer_short, output_buffer_long);
-    }
-    else if (led_array_interface->trigger_input_count == 2)
-    {
-      clear_output_buffers();
-      sprintf(output_buffer_short, "TRINPUTPIN.%d.%d", led_array_interface->trigger_input_pin_list[0], led_array_interface->trigger_input_pin_list[1]);
-      sprintf(output_buffer_long, "Trigger input pins are (%d, %d)", led_array_interface->trigger_input_pin_list[0], led_array_interface->trigger_input_pin_list[1]);
-      print(output_buffer_short, output_buffer_long);
-    }
-    else
-      return ERROR_NOT_IMPLEMENTED;
-  }
-  else
+  if (argc != 1)
     return ERROR_ARGUMENT_COUNT;
 
+  print_trigger_list("TRINPUTPIN", "Trigger input pin", led_array_interface->trigger_input_pin_list, led_array_interface->trigger_input_count);
+
   return NO_ERROR;
 }
 
 int LedArray::get_trigger_output_pins(uint16_t argc, char ** argv)
 {
-  if (argc == 1)
-  {
-    if (led_array_interface->trigger_output_count == 0)
-    {
-      clear_output_buffers();
-      sprintf(output_buffer_short, "TROUTPUTPIN.NONE");
-      sprintf(output_buffer_long, "No trigger output pins on this device.");
-      print(output_buffer_short, output_buffer_long);
-    }
-    else if (led_array_interface->trigger_output_count == 1)
-    {
-      clear_output_buffers();
-      sprintf(output_buffer_short, "TROUTPUTPIN.%d", led_array_interface->trigger_output_pin_list[0]);
-      sprintf(output_buffer_long, "Trigger output pin is %d", led_array_interface->trigger_output_pin_list[0]);
-      print(output_buffer_short, output_buffer_long);
-    }
-    else if (led_array_interface->trigger_output_count == 2)
-    {
-      clear_output_buffers();
-      sprintf(output_buffer_short, "TROUTPUTPIN.%d.%d", led_array_interface->trigger_output_pin_list[0], led_array_interface->trigger_output_pin_list[1]);
-      sprintf(output_buffer_long, "Trigger output pins are (%d, %d)", led_array_interface->trigger_output_pin_list[0], led_array_interface->trigger_output_pin_list[1]);
-      print(output_buffer_short, output_buffer_long);
-    }
-    else
-      return ERROR_NOT_IMPLEMENTED;
-  }
-  else
+  if (argc != 1)
     return ERROR_ARGUMENT_COUNT;
 
+  print_trigger_list("TROUTPUTPIN", "Trigger output pin", led_array_interface->trigger_output_pin_list, led_array_interface->trigger_output_count);
+
   return NO_ERROR;
 }
 
@@ -1285,20 +1300,24 @@ int LedArray::trigger_setup(uint16_t argc, char ** argv)
     if (debug_level > 1)
       Serial.printf(F("Trigger setup called with %d arguments.%s"), argc, SERIAL_LINE_ENDING);
     trigger_index_ = atoi(argv[1]);
-    if (trigger_index_ < 0 || trigger_index_ >= led_array_interface->trigger_output_count)
+    if (trigger_index_ < 0 || (trigger_index_ >= led_array_interface->trigger_output_count && trigger_index_ >= led_array_interface->trigger_input_count))
       return ERROR_INVALID_ARGUMENT;
 
-    // Second argument is the trigger input mode
-    LedArray::trigger_input_mode_list[trigger_index_]  = atoi(argv[2]);
+    // Second argument is the trigger input mode (devices may have different numbers of inputs and outputs)
+    if (trigger_index_ < led_array_interface->trigger_input_count)
+      LedArray::trigger_input_mode_list[trigger_index_]  = atoi(argv[2]);
 
-    // // Third argument is the trigger output mode
-    LedArray::trigger_output_mode_list[trigger_index_] = atoi(argv[3]);
+    // Third argument is the trigger output mode, followed by the pulse width and delay
+    if (trigger_index_ < led_array_interface->trigger_output_count)
+    {
+      LedArray::trigger_output_mode_list[trigger_index_] = atoi(argv[3]);
 
-    if (argc >= 5)
-      LedArray::trigger_output_pulse_width_list_us[trigger_index_] = strtoul(argv[4], NULL, 0);
+      if (argc >= 5)
+        LedArray::trigger_output_pulse_width_list_us[trigger_index_] = strtoul(argv[4], NULL, 0);
 
-     if (argc >= 5)
-       LedArray::trigger_output_start_delay_list_us[trigger_index_] = strtoul(argv[5], NULL, 0);
+      if (argc >= 6)
+        LedArray::trigger_output_start_delay_list_us[trigger_index_] = strtoul(argv[5], NULL, 0);
+    }
 
   }
   else if (argc != 1)
@@ -1306,25 +1325,32 @@ int LedArray::trigger_setup(uint16_t argc, char ** argv)
 
   if (command_mode == COMMAND_MODE_SHORT)
   {
-    for (int trigger_index = 0; trigger_index < led_array_interface->trigger_input_count; trigger_index++)
+    for (int trigger_index = 0; trigger_index < max(led_array_interface->trigger_input_count, led_array_interface->trigger_output_count); trigger_index++)
     {
       Serial.print("Trigger ");
       Serial.print(trigger_index);
-      Serial.print(" is set to mode ");
-      Serial.print(LedArray::trigger_input_mode_list[trigger_index]);
-      Serial.print(" for input and mode ");
-      Serial.print(LedArray::trigger_output_mode_list[trigger_index]);
-      Serial.print(" for output. ");
-      Serial.print("It is connected to output pin ");
-      Serial.print(LedArrayInterface::trigger_output_pin_list[trigger_index]);
-      Serial.print(" and input pin ");
-      Serial.print(LedArrayInterface::trigger_input_pin_list[trigger_index]);
-      Serial.print(" on the device. ");
-      Serial.print("The trigger output now has a pulse width of ");
-      Serial.print(LedArray::trigger_output_pulse_width_list_us[trigger_index] );
-      Serial.print("us and a start delay of ");
-      Serial.print(LedArray::trigger_output_start_delay_list_us[trigger_index]);
-      Serial.printf(F("us. %s"), SERIAL_LINE_ENDING);
+      if (trigger_index < led_array_interface->trigger_input_count)
+      {
+        Serial.print(" input is set to mode ");
+        Serial.print(LedArray::trigger_input_mode_list[trigger_index]);
+        Serial.print(" and connected to input pin ");
+        Serial.print(LedArrayInterface::trigger_input_pin_list[trigger_index]);
+        Serial.print(" on the device. ");
+      }
+      if (trigger_index < led_array_interface->trigger_output_count)
+      {
+        Serial.print(" output is set to mode ");
+        Serial.print(LedArray::trigger_output_mode_list[trigger_index]);
+        Serial.print(" and connected to output pin ");
+        Serial.print(LedArrayInterface::trigger_output_pin_list[trigger_index]);
+        Serial.print(" on the device. ");
+        Serial.print("The trigger output now has a pulse width of ");
+        Serial.print(LedArray::trigger_output_pulse_width_list_us[trigger_index] );
+        Serial.print("us and a start delay of ");
+        Serial.print(LedArray::trigger_output_start_delay_list_us[trigger_index]);
+        Serial.print("us.");
+      }
+      Serial.print(SERIAL_LINE_ENDING);
     }
   }
 
@@ -1355,13 +1381,12 @@ int LedArray::trigger_setup(uint16_t argc, char ** argv)
                     LedArray::trigger_output_pulse_width_list_us[trigger_index],
                     LedArray::trigger_output_start_delay_list_us[trigger_index]);
 
-      if (trigger_index < (led_array_interface->trigger_input_count - 1))
+      if (trigger_index < (led_array_interface->trigger_output_count - 1))
         Serial.printf(",%s", SERIAL_LINE_ENDING);
       else
         Serial.printf("%s", SERIAL_LINE_ENDING);
-
-      Serial.printf(F("    ]%s}%s"), SERIAL_LINE_ENDING, SERIAL_LINE_ENDING);
     }
+    Serial.printf(F("    ]%s}%s"), SERIAL_LINE_ENDING, SERIAL_LINE_ENDING);
   }
   return NO_ERROR;
 }
@@ -1369,71 +1394,331 @@ int LedArray::trigger_setup(uint16_t argc, char ** argv)
 /* Send a trigger pulse */
 int LedArray::send_trigger_pulse(int trigger_index, bool show_output)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   if (debug_level >= 2)
     Serial.printf(F("Called send_trigger_pulse %s"), SERIAL_LINE_ENDING);
 
   if ((trigger_index < 0) || (trigger_index >= led_array_interface->trigger_output_count))
     return ERROR_INVALID_ARGUMENT;
 
-  int status = led_array_interface->send_trigger_pulse(trigger_index, LedArray::trigger_output_pulse_width_list_us[trigger_index], false);
-
-  if (status < 0)
+  // The pulse is timed by an interval timer, so this returns once it has started. The output start delay is applied
+  // as a hold-off after the pulse, which sequences wait for (using TriggerPulses::wait_all) before the next pattern.
+  int pin = led_array_interface->trigger_output_pin_list[trigger_index];
+  if (pin <= 0)
     return ERROR_TRIGGER_CONFIG;
 
+  TriggerPulses::send(trigger_index, pin, LedArray::trigger_output_pulse_width_list_us[trigger_index],
+                      LedArray::trigger_output_start_delay_list_us[trigger_index], false, true);
+
   return NO_ERROR;
 }
 
+/* Attaches pin change interrupts to the trigger inputs which are used by sequences or strobe mode, and detaches the rest */
+void LedArray::update_trigger_input_interrupts()
+{
+  for (int trigger_index = 0; trigger_index < led_array_interface->trigger_input_count; trigger_index++)
+    led_array_interface->set_trigger_input_interrupt(trigger_index, (LedArray::trigger_input_mode_list[trigger_index] != TRIG_MODE_NONE)
+                                                                    || (trigger_index == Tlc5955Dma::get_strobe_input()));
+}
+
 /* Wait for a TTL trigger port to be in the given state */
 bool LedArray::wait_for_trigger_state(int trigger_index, bool state)
 {
-  float delayed_us = 0;
-
   // Clear Serial buffer
   while (Serial.available())
     Serial.read();
 
-  bool done = false;
-  while (!done)
+  // The timeout is tracked in cycles with a 64-bit count, since the 32-bit cycle counter wraps every few seconds
+  uint64_t timeout_cycles = (uint64_t)(LedArray::trigger_input_timeout * TRIGGER_CYCLES_PER_SECOND);
+  uint64_t elapsed_cycles = 0;
+  uint32_t serial_check_cycles = 0;
+  uint32_t previous_cycle_count = ARM_DWT_CYCCNT;
+  trigger_edge_t edge;
+  bool edge_seen = false;
+
+  while (true)
   {
+    // The state is read before the queue, so an edge which arrives in between is not left for the next wait
+    bool state_reached = (led_array_interface->trigger_input_state[trigger_index] == state);
 
-    // Break the loop if we've received a serial command
-    if (Serial.available())
+    // Take the oldest edge to the requested state on this input, so its time can be used to measure latency. Short
+    // pulses may have already ended, but still count.
+    if (TriggerEdgeQueue::pop(trigger_index, state, &edge))
     {
-      while (Serial.available())
-        Serial.read();
-      Serial.printf(F("WARNING (LedArray::wait_for_trigger_state): Cancelling on pin %d due to serial interrupt %s"), trigger_index, SERIAL_LINE_ENDING);
-      clear();
-      return false;
+      edge_seen = true;
+      break;
     }
 
+    // The input may have been in the requested state since before the sequence started
+    if (state_reached)
+      break;
+
+    uint32_t cycle_count = ARM_DWT_CYCCNT;
+    elapsed_cycles += cycle_count - previous_cycle_count;
+    serial_check_cycles += cycle_count - previous_cycle_count;
+    previous_cycle_count = cycle_count;
+
     // Break the loop if there's a timeout
-    if (delayed_us > LedArray::trigger_input_timeout * 1000000.0)
+    if (elapsed_cycles > timeout_cycles)
     {
       Serial.printf(F("WARNING (LedArray::wait_for_trigger_state): Exceeding max delay for trigger input %d (%.2f sec.) %s"), trigger_index, LedArray::trigger_input_timeout, SERIAL_LINE_ENDING);
       return false;
     }
 
-    // Do basic debouncing
-    if (led_array_interface->trigger_input_state[trigger_index] == state)
+    // Break the loop if we've received a serial command (checked every millisecond)
+    if (serial_check_cycles > TRIGGER_CYCLES_PER_SECOND / 1000)
     {
-      done = true;
+      serial_check_cycles = 0;
+      if (Serial.available())
+      {
+        while (Serial.available())
+          Serial.read();
+        Serial.printf(F("WARNING (LedArray::wait_for_trigger_state): Cancelling on pin %d due to serial interrupt %s"), trigger_index, SERIAL_LINE_ENDING);
+        clear();
+        return false;
+      }
     }
-    else
+  }
+
+  // This edge is answered by the next pattern latched, once the previous pattern has been latched. Edges which arrive
+  // before then (e.g. from a bouncing input) are discarded at that latch, so they cannot satisfy the next wait. In strobe
+  // mode the strobe input decides when patterns are latched, so they are discarded now and latency is not measured.
+  if (Tlc5955Dma::get_strobe_input() >= 0)
+    TriggerEdgeQueue::flush(trigger_index);
+  else
+  {
+    led_array_interface->wait_for_update();
+    TriggerEdgeQueue::flush_on_latch(trigger_index);
+    if (edge_seen)
+      TriggerLatency::arm(edge.cycle_count);
+  }
+  return true;
+}
+
+/* Prints trigger input edge to LED latch latency, in microseconds */
+int LedArray::print_trigger_latency(uint16_t argc, char ** argv)
+{
+  if (argc == 2 && strcmp(argv[1], "reset") == 0)
+    TriggerLatency::reset();
+  else if (argc != 1)
+    return ERROR_ARGUMENT_COUNT;
+
+  trigger_latency_stats_t stats;
+  TriggerLatency::get_stats(&stats);
+  float cycles_per_us = (float)TRIGGER_CYCLES_PER_SECOND / 1000000.0;
+
+  clear_output_buffers();
+  sprintf(output_buffer_short, "TRLATENCY.%.2f.%.2f.%.2f.%lu", (float)stats.last_cycles / cycles_per_us, (float)stats.max_cycles / cycles_per_us, (float)stats.mean_cycles / cycles_per_us, (unsigned long)stats.count);
+  snprintf(output_buffer_long, MAX_RESPONSE_LENGTH_LONG, "Trigger to LED latency (us): last %.1f, max %.1f, mean %.1f (%lu, %lu dropped)",
+           (float)stats.last_cycles / cycles_per_us, (float)stats.max_cycles / cycles_per_us, (float)stats.mean_cycles / cycles_per_us,
+           (unsigned long)stats.count, (unsigned long)TriggerEdgeQueue::get_dropped_count());
+  print(output_buffer_short, output_buffer_long);
+
+  return NO_ERROR;
+}
+
+/* Prints jitter statistics from the trigger trace, in microseconds, or dumps the trace itself */
+int LedArray::print_trigger_trace(uint16_t argc, char ** argv)
+{
+  if (argc == 2 && strcmp(argv[1], "reset") == 0)
+  {
+    TriggerTrace::reset();
+    return NO_ERROR;
+  }
+  else if (argc != 1 && !(argc == 2 && strcmp(argv[1], "dump") == 0))
+    return ERROR_ARGUMENT_COUNT;
+
+  uint16_t entry_count = TriggerTrace::snapshot(trigger_trace_snapshot);
+
+  if (argc == 2)
+  {
+    // Compact dump, one event per line: type (L=latch, O=output, I=input), trigger index, state, and cycles since the first event
+    const char event_names[] = {'L', 'O', 'I'};
+    Serial.printf(F("TRTRACE.%lu.%u%s"), (unsigned long)TRIGGER_CYCLES_PER_SECOND, entry_count, SERIAL_LINE_ENDING);
+    for (uint16_t entry_index = 0; entry_index < entry_count; entry_index++)
     {
-      delayMicroseconds(INPUT_TRIGGER_WAIT_PERIOD_US);
-      delayed_us += INPUT_TRIGGER_WAIT_PERIOD_US;
+      const trigger_trace_entry_t * entry = &trigger_trace_snapshot[entry_index];
+      Serial.printf(F("%c%u%u.%lu%s"), event_names[entry->event], entry->index, entry->state,
+                    (unsigned long)(entry->cycle_count - trigger_trace_snapshot[0].cycle_count), SERIAL_LINE_ENDING);
     }
+    return NO_ERROR;
   }
-  return true;
+
+  // Pattern period, pattern latch to output pulse, and output pulse to the input edge which responds to it
+  const uint8_t interval_events[][2] = {{TRIGGER_TRACE_LATCH, TRIGGER_TRACE_LATCH},
+                                        {TRIGGER_TRACE_LATCH, TRIGGER_TRACE_OUTPUT},
+                                        {TRIGGER_TRACE_OUTPUT, TRIGGER_TRACE_INPUT}};
+  const char * interval_names_short[] = {"PERIOD", "LATCHOUT", "OUTIN"};
+  const char * interval_names_long[] = {"Latch period", "Latch to output", "Output to input"};
+
+  float cycles_per_us = (float)TRIGGER_CYCLES_PER_SECOND / 1000000.0;
+  trigger_jitter_stats_t stats;
+  for (uint8_t interval_index = 0; interval_index < 3; interval_index++)
+  {
+    TriggerTrace::get_jitter_stats(trigger_trace_snapshot, entry_count, interval_events[interval_index][0], interval_events[interval_index][1], &stats);
+
+    clear_output_buffers();
+    sprintf(output_buffer_short, "TRJITTER.%s.%lu.%.2f.%.2f.%.2f.%.2f", interval_names_short[interval_index], (unsigned long)stats.count,
+            (float)stats.min_cycles / cycles_per_us, (float)stats.mean_cycles / cycles_per_us,
+            (float)stats.max_cycles / cycles_per_us, (float)stats.p99_cycles / cycles_per_us);
+    snprintf(output_buffer_long, MAX_RESPONSE_LENGTH_LONG, "%s (us): min %.2f, mean %.2f, max %.2f, p99 %.2f (%lu)",
+             interval_names_long[interval_index], (float)stats.min_cycles / cycles_per_us, (float)stats.mean_cycles / cycles_per_us,
+             (float)stats.max_cycles / cycles_per_us, (float)stats.p99_cycles / cycles_per_us, (unsigned long)stats.count);
+    print(output_buffer_short, output_buffer_long);
+  }
+
+  return NO_ERROR;
+}
+
+/* Converts the time taken by BENCHMARK_REPETITIONS calls to ns per call */
+static unsigned long benchmark_ns(uint32_t elapsed_us)
+{
+  return (unsigned long)((uint64_t)elapsed_us * 1000 / BENCHMARK_REPETITIONS);
+}
+
+/* Selects LEDs for a primative as was done before the radial NA of each LED was stored, computing it for every LED and
+   rotating and rounding the coordinates of every LED for half circles. Used by bench.select for comparison. */
+static bool is_led_in_primative_computed(uint8_t primative, float parameter, float start_na, float end_na, int16_t led_index)
+{
+  float x = LedArrayInterface::led_position_list_na[led_index][0];
+  float y = LedArrayInterface::led_position_list_na[led_index][1];
+
+  if (primative == PRIMATIVE_HALF_CIRCLE)
+  {
+    float angle_rad = parameter / 180.0 * 3.14;
+    float x_rotated = round((cos(angle_rad) * x - sin(angle_rad) * y) * 100.0) / 100.0;
+    float y_rotated = round((sin(angle_rad) * x + cos(angle_rad) * y) * 100.0) / 100.0;
+    float d = sqrt(x_rotated * x_rotated + y_rotated * y_rotated);
+    return (d > (start_na) && (d <= (end_na)) && (y_rotated > 0.0));
+  }
+
+  float d = sqrt(x * x + y * y);
+  if (primative == PRIMATIVE_QUADRANT)
+    return ((x < 0) && (y > 0) && (d <= end_na) && (d >= start_na));  // Quadrant 0
+  return ((d >= start_na) && (d <= end_na));
+}
+
+/* Times drawing operations on the device, so changes to them can be checked. The grayscale buffer is written without
+   latching, and the array is cleared afterwards. */
+int LedArray::benchmark(uint16_t argc, char ** argv)
+{
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+  if (argc != 2)
+    return ERROR_ARGUMENT_COUNT;
+
+  clear_output_buffers();
+  if (strcmp(argv[1], "fill") == 0)
+  {
+    // One LED at a time (as fill_array does), then the whole-array path of set_led(-1, ...)
+    uint32_t start_us = micros();
+    for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+      for (int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
+        for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+          led_array_interface->set_led(led_index, color_channel_index, (uint16_t)repetition);
+    uint32_t led_list_us = micros() - start_us;
+
+    start_us = micros();
+    for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+      led_array_interface->set_led(-1, -1, (uint16_t)repetition);
+    uint32_t whole_array_us = micros() - start_us;
+
+    start_us = micros();
+    for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+      led_array_interface->clear_frame();
+    uint32_t clear_frame_us = micros() - start_us;
+
+    sprintf(output_buffer_short, "BENCH.FILL.%lu.%lu.%lu", benchmark_ns(led_list_us), benchmark_ns(whole_array_us), benchmark_ns(clear_frame_us));
+    snprintf(output_buffer_long, MAX_RESPONSE_LENGTH_LONG, "Fill %d LEDs (ns): %lu one at a time, %lu whole array, %lu clear frame",
+             led_array_interface->led_count, benchmark_ns(led_list_us), benchmark_ns(whole_array_us), benchmark_ns(clear_frame_us));
+  }
+  else if (strcmp(argv[1], "select") == 0)
+  {
+    // Checks every LED against a half circle (at 0 degrees), quadrant 0 and an annulus, from 0.2NA to the objective NA,
+    // using the stored radial NA and computing it per LED as before.
+    const uint8_t primatives[3] = {PRIMATIVE_HALF_CIRCLE, PRIMATIVE_QUADRANT, PRIMATIVE_CIRCLE};
+    unsigned long stored_ns[3], computed_ns[3];
+    volatile uint16_t selected_count = 0;  // Keeps the selection from being optimized away
+    for (int primative_index = 0; primative_index < 3; primative_index++)
+    {
+      uint32_t start_us = micros();
+      for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+        for (int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
+          selected_count += is_led_in_primative(primatives[primative_index], 0, false, 0.2, objective_na, 0, 1, led_index);
+      stored_ns[primative_index] = benchmark_ns(micros() - start_us);
+
+      start_us = micros();
+      for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+        for (int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
+          selected_count += is_led_in_primative_computed(primatives[primative_index], 0, 0.2, objective_na, led_index);
+      computed_ns[primative_index] = benchmark_ns(micros() - start_us);
+    }
+
+    sprintf(output_buffer_short, "BENCH.SELECT.%lu.%lu.%lu.%lu.%lu.%lu", stored_ns[0], computed_ns[0], stored_ns[1], computed_ns[1], stored_ns[2], computed_ns[2]);
+    snprintf(output_buffer_long, MAX_RESPONSE_LENGTH_LONG, "Select (ns, stored/computed): half %lu/%lu, quad %lu/%lu, annulus %lu/%lu",
+             stored_ns[0], computed_ns[0], stored_ns[1], computed_ns[1], stored_ns[2], computed_ns[2]);
+  }
+  else
+    return ERROR_INVALID_ARGUMENT;
+
+  led_array_interface->clear();
+  print(output_buffer_short, output_buffer_long);
+
+  return NO_ERROR;
+}
+
+/* Sets the trigger input which gates LEDs in custom sequences (strobe mode), or disables strobe mode if -1 */
+int LedArray::set_strobe_input(uint16_t argc, char ** argv)
+{
+  if (argc == 2)
+  {
+    if (timed_sequence_running)
+      return ERROR_SEQUENCE_RUNNING;
+
+    int trigger_index = atoi(argv[1]);
+    if ((trigger_index < -1) || (trigger_index >= led_array_interface->trigger_input_count))
+      return ERROR_INVALID_ARGUMENT;
+
+    // The exposure is active while the input is in the state given by its polarity. Disabling strobe mode turns off
+    // a pattern which is still lit for an exposure, and updates wait for an exposure no longer than the input timeout.
+    Tlc5955Dma::set_strobe_timeout((uint32_t)(LedArray::trigger_input_timeout * 1000));
+    Tlc5955Dma::set_strobe_input(trigger_index, (trigger_index >= 0) ? &LedArray::trigger_input_polarity_list[trigger_index] : NULL);
+    update_trigger_input_interrupts();
+  }
+  else if (argc > 2)
+    return ERROR_ARGUMENT_COUNT;
+
+  clear_output_buffers();
+  sprintf(output_buffer_short, "STROBE.%d", Tlc5955Dma::get_strobe_input());
+  if (Tlc5955Dma::get_strobe_input() >= 0)
+    sprintf(output_buffer_long, "Strobe mode uses trigger input %d.", Tlc5955Dma::get_strobe_input());
+  else
+    sprintf(output_buffer_long, "Strobe mode is disabled.");
+  print(output_buffer_short, output_buffer_long);
+
+  return NO_ERROR;
 }
 
 int LedArray::trigger_input_test(uint16_t channel)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+  if (channel >= led_array_interface->trigger_input_count)
+    return ERROR_INVALID_ARGUMENT;
+
   set_led(-1, -1, (uint8_t)0);
   led_array_interface->update();
+
+  // The input may not be in use, so listen to it for the duration of the test
+  led_array_interface->set_trigger_input_interrupt(channel, true);
   Serial.print(LedArrayInterface::trigger_input_state[channel]); Serial.print(SERIAL_LINE_ENDING);
   Serial.print("Begin trigger input test for channel "); Serial.print(channel); Serial.print(SERIAL_LINE_ENDING);
+  TriggerEdgeQueue::flush();
   bool result = wait_for_trigger_state(channel, !LedArrayInterface::trigger_input_state[channel]);
+  TriggerLatency::disarm();
+  update_trigger_input_interrupts();
   if (result)
   {
     Serial.print("Passed trigger input test for channel "); Serial.print(channel); Serial.print(SERIAL_LINE_ENDING);
@@ -1450,9 +1735,16 @@ int LedArray::trigger_input_test(uint16_t channel)
 
 int LedArray::draw_led_list(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
+  for (int arg_index = 1; arg_index < argc; arg_index++)
+    if (strtoul(argv[arg_index], NULL, 0) >= (uint32_t)led_array_interface->led_count)
+      return ERROR_ARGUMENT_RANGE;
+
   // Clear if desired
   if (auto_clear_flag)
-    clear();
+    led_array_interface->clear_frame();
 
   // Parse inputs
   if (argc == 1)
@@ -1463,8 +1755,123 @@ int LedArray::draw_led_list(uint16_t argc, char ** argv)
     for (int arg_index = 1; arg_index < argc; arg_index++)
       for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
         set_led(strtoul(argv[arg_index], NULL, 0), color_channel_index, led_value[color_channel_index]);
-    led_array_interface->update();
   }
+  led_array_interface->update();
+
+  return NO_ERROR;
+}
+
+/* Draw a list of LEDs passed as packed indicies (binary command frames) */
+int LedArray::draw_led_list(uint16_t led_count, const uint16_t * led_list)
+{
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
+  for (uint16_t led_index = 0; led_index < led_count; led_index++)
+    if (led_list[led_index] >= led_array_interface->led_count)
+      return ERROR_ARGUMENT_RANGE;
+
+  // Clear if desired
+  if (auto_clear_flag)
+    led_array_interface->clear_frame();
+
+  for (uint16_t led_index = 0; led_index < led_count; led_index++)
+    for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+      set_led(led_list[led_index], color_channel_index, led_value[color_channel_index]);
+  led_array_interface->update();
+
+  return NO_ERROR;
+}
+
+/* Decode base64 text in place. Returns the number of bytes decoded, or -1 if the text is not valid base64. */
+static int decode_base64(char * text)
+{
+  uint32_t accumulator = 0;
+  int bit_count = 0;
+  int byte_count = 0;
+
+  for (char * c = text; *c != '\0'; c++)
+  {
+    int sextet;
+    if ((*c >= 'A') && (*c <= 'Z'))
+      sextet = *c - 'A';
+    else if ((*c >= 'a') && (*c <= 'z'))
+      sextet = *c - 'a' + 26;
+    else if ((*c >= '0') && (*c <= '9'))
+      sextet = *c - '0' + 52;
+    else if (*c == '+')
+      sextet = 62;
+    else if (*c == '/')
+      sextet = 63;
+    else if (*c == '=')
+      break;
+    else
+      return -1;
+
+    // Output never overtakes input, since each character yields at most one byte
+    accumulator = (accumulator << 6) | sextet;
+    bit_count += 6;
+    if (bit_count >= 8)
+    {
+      bit_count -= 8;
+      text[byte_count++] = (char)((accumulator >> bit_count) & 0xFF);
+    }
+  }
+
+  return byte_count;
+}
+
+/* Draw a full-array pattern from a base64-encoded bitmask (bit n of byte n / 8 is LED n) */
+int LedArray::draw_led_bitmask(uint16_t argc, char ** argv)
+{
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
+  if (argc != 2)
+    return ERROR_ARGUMENT_COUNT;
+
+  int mask_byte_count = decode_base64(argv[1]);
+  if (mask_byte_count < 0)
+    return ERROR_INVALID_ARGUMENT;
+
+  return draw_led_bitmask((const uint8_t *)argv[1], (uint16_t)mask_byte_count);
+}
+
+/* Draw a full-array pattern from a packed bitmask, with lit LEDs set to the current color and brightness */
+int LedArray::draw_led_bitmask(const uint8_t * led_mask, uint16_t mask_byte_count)
+{
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
+  if (mask_byte_count < (led_array_interface->led_count + 7) / 8)
+    return ERROR_ARGUMENT_COUNT;
+
+  // The mask describes every LED, so the pattern is always replaced
+  led_array_interface->clear_frame();
+
+  for (uint16_t led_number = 0; led_number < led_array_interface->led_count; led_number++)
+  {
+    if (!((led_mask[led_number / 8] >> (led_number % 8)) & 1))
+      continue;
+    for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+      set_led(led_number, color_channel_index, led_value[color_channel_index]);
+  }
+  led_array_interface->update();
+
+  return NO_ERROR;
+}
+
+/* Draw a full-array frame of 16-bit values, ordered by LED and then color channel. Cosine weighting is not applied. */
+int LedArray::draw_led_frame(uint16_t value_count, const uint16_t * led_values)
+{
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
+  if (value_count != led_array_interface->led_count * led_array_interface->color_channel_count)
+    return ERROR_ARGUMENT_COUNT;
+
+  led_array_interface->set_led_frame(led_values);
+  led_array_interface->update();
 
   return NO_ERROR;
 }
@@ -1518,50 +1925,76 @@ int LedArray::set_brightness(int16_t argc, char ** argv)
 
   if (argc == 1)
     ; // pass
+  else if (argc == 3 && atoi(argv[2]) != 16)
+    return ERROR_INVALID_ARGUMENT; // Values are 8-bit unless a bit depth of 16 is given, as in ssc
   else
   {
     if (strcmp(argv[1], "max") == 0)
     {
-      led_brightness = UINT8_MAX;
+      led_brightness = UINT16_MAX;
     }
     else if (strcmp(argv[1], "min") == 0)
     {
-      led_brightness = 1;
+      led_brightness = UINT8_TO_UINT16_SCALE;
     }
     else if (strcmp(argv[1], "half") == 0)
     {
-      led_brightness = (uint8_t) ((float)UINT8_MAX / 2.0);
+      led_brightness = (uint8_t) ((float)UINT8_MAX / 2.0) * UINT8_TO_UINT16_SCALE;
     }
     else if (strcmp(argv[1], "quarter") == 0)
     {
-      led_brightness = (uint8_t) ((float)UINT8_MAX / 4.0);
+      led_brightness = (uint8_t) ((float)UINT8_MAX / 4.0) * UINT8_TO_UINT16_SCALE;
     }
+    else if (argc == 3 && atoi(argv[2]) == 16)
+      led_brightness = (uint16_t) strtoul(argv[1], NULL, 0);  // 16-bit brightness
     else
-      led_brightness = (uint8_t) strtoul(argv[1], NULL, 0);
+      led_brightness = (uint8_t) strtoul(argv[1], NULL, 0) * UINT8_TO_UINT16_SCALE;
   }
 
   // Set LED value based on color and brightness
-  for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
-    led_value[color_channel_index] = (uint8_t) ceil((float) led_color[color_channel_index] / (float) UINT8_MAX * (float) led_brightness);
+  update_led_value();
 
-  // Print current brightness
+  // Print current brightness, using 8-bit values where possible
   clear_output_buffers();
-  sprintf(output_buffer_short, "SB.%u", led_brightness);
-  sprintf(output_buffer_long, "Current brightness value is %u.", led_brightness);
+  if (led_brightness % UINT8_TO_UINT16_SCALE == 0)
+  {
+    sprintf(output_buffer_short, "SB.%u", led_brightness / UINT8_TO_UINT16_SCALE);
+    sprintf(output_buffer_long, "Current brightness value is %u.", led_brightness / UINT8_TO_UINT16_SCALE);
+  }
+  else
+  {
+    sprintf(output_buffer_short, "SB.%u.16", led_brightness);
+    sprintf(output_buffer_long, "Current brightness value is %u (16-bit).", led_brightness);
+  }
   print(output_buffer_short, output_buffer_long);
 
   return NO_ERROR;
 }
 
+/* Computes the 16-bit value of each color channel from the color balance and brightness */
+void LedArray::update_led_value()
+{
+  for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+    led_value[color_channel_index] = (uint16_t) ceil((float) led_color[color_channel_index] / (float) UINT8_MAX * (float) led_brightness);
+}
+
 /* Allows setting of current color buffer, which is respected by most other commands */
 int LedArray::set_single_color(int16_t argc, char ** argv)
 {
   if (argc == 1)
     ; // Do nothing, print result
-  else if (argc == 3)
+  else if (argc == 3 || argc == 4)
   {
     uint8_t color_channel = atoi(argv[1]);
-    uint8_t value = atoi(argv[2]);
+    uint16_t value;
+
+    // Values are 8-bit unless a bit depth of 16 is given
+    if (argc == 4 && atoi(argv[3]) == 16)
+      value = (uint16_t) strtoul(argv[2], NULL, 0);
+    else if (argc == 3)
+      value = (uint8_t) atoi(argv[2]) * UINT8_TO_UINT16_SCALE;
+    else
+      return ERROR_INVALID_ARGUMENT;
 
     if ((color_channel >= 0) & (color_channel < led_array_interface->color_channel_count))
       led_value[color_channel] = value;
@@ -1572,20 +2005,31 @@ int LedArray::set_single_color(int16_t argc, char ** argv)
   else
     return ERROR_ARGUMENT_COUNT;
 
-  // Print current color value
+  // Print current color value, using 8-bit values where possible
   clear_output_buffers();
 
+  uint16_t scale = UINT8_TO_UINT16_SCALE;
+  const char * bit_depth_suffix = "";
+  for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+  {
+    if (led_value[color_channel_index] % UINT8_TO_UINT16_SCALE != 0)
+    {
+      scale = 1;
+      bit_depth_suffix = ".16";
+    }
+  }
+
   if (led_array_interface->color_channel_count == 3)
   {
-    sprintf(output_buffer_short, "CO.%d.%d.%d", led_value[0], led_value[1], led_value[2]);
-    sprintf(output_buffer_long, "Current color balance values are %d.%d.%d", led_value[0], led_value[1], led_value[2]);
+    sprintf(output_buffer_short, "CO.%u.%u.%u%s", led_value[0] / scale, led_value[1] / scale, led_value[2] / scale, bit_depth_suffix);
+    sprintf(output_buffer_long, "Current color balance values are %u.%u.%u%s", led_value[0] / scale, led_value[1] / scale, led_value[2] / scale, bit_depth_suffix);
     print(output_buffer_short, output_buffer_long);
   }
   else if (led_array_interface->color_channel_count == 1)
   {
     // Print single color
-    sprintf(output_buffer_short, "CO.%d", led_value[0]);
-    sprintf(output_buffer_long, "Current color balance values are %d.", led_value[0]);
+    sprintf(output_buffer_short, "CO.%u%s", led_value[0] / scale, bit_depth_suffix);
+    sprintf(output_buffer_long, "Current color balance values are %u%s.", led_value[0] / scale, bit_depth_suffix);
     print(output_buffer_short, output_buffer_long);
   }
 
@@ -1638,28 +2082,150 @@ int LedArray::set_color(int16_t argc, char ** argv)
     else
       return ERROR_INVALID_ARGUMENT;
 
-    // Normalize color
-    uint8_t max_value = max(max(led_color[0], led_color[1]), led_color[2]);
-    for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
-      led_color[color_channel_index]  = (uint8_t) round(UINT8_MAX * ((float) led_color[color_channel_index]) / ((float) max_value));
+    // Normalize color
+    uint8_t max_value = max(max(led_color[0], led_color[1]), led_color[2]);
+    for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+      led_color[color_channel_index]  = (uint8_t) round(UINT8_MAX * ((float) led_color[color_channel_index]) / ((float) max_value));
+
+    // Set LED value based on color and brightness
+    update_led_value();
+
+    // Print current color value
+    clear_output_buffers();
+
+    sprintf(output_buffer_short, "CO.%d.%d.%d", led_color[0], led_color[1], led_color[2]);
+    sprintf(output_buffer_long, "Current color balance values are %d.%d.%d", led_color[0], led_color[1], led_color[2]);
+    print(output_buffer_short, output_buffer_long);
+  }
+  else
+  {
+    return ERROR_NOT_SUPPORTED_BY_DEVICE;
+  }
+
+  return NO_ERROR;
+}
+
+/* Returns true if an LED is part of a drawing primative. Half circles are rotated using the given sine and cosine of their angle. */
+bool LedArray::is_led_in_primative(uint8_t primative, float parameter, bool include_center, float start_na, float end_na,
+                                   float rotation_sin, float rotation_cos, int16_t led_index)
+{
+  float x = LedArrayInterface::led_position_list_na[led_index][0];
+  float y = LedArrayInterface::led_position_list_na[led_index][1];
+  float d = LedArrayInterface::led_position_list_na_radius[led_index];
+
+  if (primative == PRIMATIVE_QUADRANT)
+  {
+    int quadrant_number = (int)parameter;
+    if (!include_center)
+      return (  (quadrant_number == 0 && (x < 0) && (y > 0) && (d <= end_na) && (d >= start_na))
+                || (quadrant_number == 1 && (x > 0) && (y > 0) && (d <= end_na) && (d >= start_na))
+                || (quadrant_number == 2 && (x > 0) && (y < 0) && (d <= end_na) && (d >= start_na))
+                || (quadrant_number == 3 && (x < 0) && (y < 0) && (d <= end_na) && (d >= start_na)));
+    else
+      return (  (quadrant_number == 0 && (x <= 0) && (y >= 0) && (d <= end_na) && (d >= start_na))
+                || (quadrant_number == 1 && (x >= 0) && (y >= 0) && (d <= end_na) && (d >= start_na))
+                || (quadrant_number == 2 && (x >= 0) && (y <= 0) && (d <= end_na) && (d >= start_na))
+                || (quadrant_number == 3 && (x <= 0) && (y <= 0) && (d <= end_na) && (d >= start_na)));
+  }
+  else if (primative == PRIMATIVE_HALF_CIRCLE)
+  {
+    // LEDs within 0.005NA of the dividing line are excluded (the rotated coordinates used to be rounded to 0.01NA)
+    float y_rotated = rotation_sin * x + rotation_cos * y;
+    return (d > (start_na) && (d <= (end_na)) && (y_rotated >= 0.005));
+  }
+  else
+    return ((d >= start_na) && (d <= end_na));
+}
+
+/* Draws a primative with the current LED values, using the pattern cache to avoid recomputing which LEDs it contains */
+void LedArray::draw_primative(uint8_t primative, float parameter, bool include_center, float start_na, float end_na)
+{
+  float rotation_sin = 0, rotation_cos = 1;
+  if (primative == PRIMATIVE_HALF_CIRCLE)
+  {
+    float angle_rad = parameter / 180.0 * 3.14;
+    rotation_sin = sin(angle_rad);
+    rotation_cos = cos(angle_rad);
+  }
+
+  // Only LEDs within the NA range of the primative need to be checked
+  uint16_t first_index = find_na_index(start_na, true);
+  uint16_t last_index = find_na_index(end_na, false);
+
+  // Devices with more LEDs than the cache can hold draw primatives directly
+  if (led_array_interface->led_count > PATTERN_CACHE_MAX_LED_COUNT)
+  {
+    for (uint16_t sorted_index = first_index; sorted_index < last_index; sorted_index++)
+    {
+      int16_t led_index = LedArrayInterface::led_na_sorted_list[sorted_index];
+      if (is_led_in_primative(primative, parameter, include_center, start_na, end_na, rotation_sin, rotation_cos, led_index))
+      {
+        for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+          set_led(led_index, color_channel_index, led_value[color_channel_index]);
+      }
+    }
+    return;
+  }
+
+  // Look for this primative in the cache, keeping track of the least recently used entry
+  pattern_cache_entry_t * entry = NULL;
+  pattern_cache_entry_t * oldest_entry = &pattern_cache[0];
+  for (int cache_index = 0; cache_index < PATTERN_CACHE_LENGTH; cache_index++)
+  {
+    pattern_cache_entry_t * candidate = &pattern_cache[cache_index];
+    if (candidate->valid && (candidate->primative == primative) && (candidate->parameter == parameter)
+        && (candidate->include_center == include_center) && (candidate->start_na == start_na) && (candidate->end_na == end_na))
+    {
+      entry = candidate;
+      break;
+    }
 
-    // Set LED value based on color and brightness
-    for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
-      led_value[color_channel_index] = (uint8_t) (((float) led_color[color_channel_index] / UINT8_MAX) * (float) led_brightness);
+    if (!candidate->valid || (oldest_entry->valid && (candidate->last_used < oldest_entry->last_used)))
+      oldest_entry = candidate;
+  }
 
-    // Print current color value
-    clear_output_buffers();
+  // Compute the LED mask for new primatives
+  if (entry == NULL)
+  {
+    if (debug_level >= 2)
+      Serial.printf(F("Caching primative %d (%.2f) from %.2fNA to %.2fNA%s"), primative, parameter, start_na, end_na, SERIAL_LINE_ENDING);
 
-    sprintf(output_buffer_short, "CO.%d.%d.%d", led_color[0], led_color[1], led_color[2]);
-    sprintf(output_buffer_long, "Current color balance values are %d.%d.%d", led_color[0], led_color[1], led_color[2]);
-    print(output_buffer_short, output_buffer_long);
+    entry = oldest_entry;
+    entry->primative = primative;
+    entry->parameter = parameter;
+    entry->include_center = include_center;
+    entry->start_na = start_na;
+    entry->end_na = end_na;
+    memset(entry->led_mask, 0, sizeof(entry->led_mask));
+    for (uint16_t sorted_index = first_index; sorted_index < last_index; sorted_index++)
+    {
+      int16_t led_index = LedArrayInterface::led_na_sorted_list[sorted_index];
+      if (is_led_in_primative(primative, parameter, include_center, start_na, end_na, rotation_sin, rotation_cos, led_index))
+        entry->led_mask[led_index / 32] |= (uint32_t)1 << (led_index % 32);
+    }
+    entry->valid = true;
   }
-  else
+  entry->last_used = ++pattern_cache_clock;
+
+  // Draw LEDs in the mask
+  for (uint16_t word_index = 0; word_index < PATTERN_CACHE_MASK_WORDS; word_index++)
   {
-    return ERROR_NOT_SUPPORTED_BY_DEVICE;
+    uint32_t mask_word = entry->led_mask[word_index];
+    while (mask_word)
+    {
+      uint8_t bit_index = __builtin_ctz(mask_word);
+      mask_word &= mask_word - 1;
+      for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+        set_led(word_index * 32 + bit_index, color_channel_index, led_value[color_channel_index]);
+    }
   }
+}
 
-  return NO_ERROR;
+/* Clears the pattern cache, which must be done whenever the LED NA positions change */
+void LedArray::invalidate_pattern_cache()
+{
+  for (int cache_index = 0; cache_index < PATTERN_CACHE_LENGTH; cache_index++)
+    pattern_cache[cache_index].valid = false;
 }
 
 /* Draws a single quadrant of LEDs using standard quadrant indexing (top left is 0, moving clockwise) */
@@ -1672,35 +2238,7 @@ void LedArray::draw_primative_quadrant(int quadrant_number, float start_na, floa
     Serial.print(SERIAL_LINE_ENDING);
   }
 
-  for ( int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
-  {
-    float x = LedArrayInterface::led_position_list_na[led_index][0];
-    float y = LedArrayInterface::led_position_list_na[led_index][1];
-    float d = sqrt(x * x + y * y);
-
-    if (!include_center)
-    {
-      if (  (quadrant_number == 0 && (x < 0) && (y > 0) && (d <= end_na) && (d >= start_na))
-            || (quadrant_number == 1 && (x > 0) && (y > 0) && (d <= end_na) && (d >= start_na))
-            || (quadrant_number == 2 && (x > 0) && (y < 0) && (d <= end_na) && (d >= start_na))
-            || (quadrant_number == 3 && (x < 0) && (y < 0) && (d <= end_na) && (d >= start_na)))
-      {
-        for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
-          set_led(led_index, color_channel_index, led_value[color_channel_index]);
-      }
-    }
-    else
-    {
-      if (  (quadrant_number == 0 && (x <= 0) && (y >= 0) && (d <= end_na) && (d >= start_na))
-            || (quadrant_number == 1 && (x >= 0) && (y >= 0) && (d <= end_na) && (d >= start_na))
-            || (quadrant_number == 2 && (x >= 0) && (y <= 0) && (d <= end_na) && (d >= start_na))
-            || (quadrant_number == 3 && (x <= 0) && (y <= 0) && (d <= end_na) && (d >= start_na)))
-      {
-        for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
-          set_led(led_index, color_channel_index, led_value[color_channel_index]);
-      }
-    }
-  }
+  draw_primative(PRIMATIVE_QUADRANT, quadrant_number, include_center, start_na, end_na);
 }
 
 /* Draws a single half-circle of LEDs using standard quadrant indexing (top left is 0, moving clockwise) */
@@ -1713,27 +2251,7 @@ void LedArray::draw_primative_half_circle(float angle_deg, float start_na, float
     Serial.print(SERIAL_LINE_ENDING);
   }
 
-  float angle_rad = angle_deg / 180.0 * 3.14;
-
-  float x, y, d, x_rotated, y_rotated;
-  for ( int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
-  {
-    // Get raw coordinates
-    x = LedArrayInterface::led_position_list_na[led_index][0];
-    y = LedArrayInterface::led_position_list_na[led_index][1];
-
-    // Rotate
-    x_rotated = round((cos(angle_rad) * x - sin(angle_rad) * y) * 100.0) / 100.0;
-    y_rotated = round((sin(angle_rad) * x + cos(angle_rad) * y) * 100.0) / 100.0;
-    d = sqrt(x_rotated * x_rotated + y_rotated * y_rotated);
-
-    // Filter rotated coordinates
-    if (d > (start_na) && (d <= (end_na)) && (y_rotated > 0.0))
-    {
-      for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
-        set_led(led_index, color_channel_index, led_value[color_channel_index]);
-    }
-  }
+  draw_primative(PRIMATIVE_HALF_CIRCLE, angle_deg, false, start_na, end_na);
 }
 
 /* Draws a circle or annulus of LEDs */
@@ -1749,23 +2267,20 @@ void LedArray::draw_primative_circle(float start_na, float end_na)
   }
 
   // Clear array first (helps eleminate weird patterns)
-  clear();
+  led_array_interface->clear_frame();
 
-  float d;
-  for ( int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
-  {
-    d = sqrt(LedArrayInterface::led_position_list_na[led_index][0] * LedArrayInterface::led_position_list_na[led_index][0] + LedArrayInterface::led_position_list_na[led_index][1] * LedArrayInterface::led_position_list_na[led_index][1]);
-    if ((d >= start_na) && (d <= end_na))
-    {
-      for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
-        set_led(led_index, color_channel_index, led_value[color_channel_index]);
-    }
-  }
+  draw_primative(PRIMATIVE_CIRCLE, 0, false, start_na, end_na);
 }
 
 /* Scan brightfield LEDs */
 int LedArray::scan_led_range(uint16_t delay_ms, float start_na, float end_na, bool print_indicies, uint16_t sequence_run_count)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
+  // Trigger input edges seen before the sequence starts are stale
+  TriggerEdgeQueue::flush();
+
 
   // Debug setting print
   if (debug_level)
@@ -1776,24 +2291,10 @@ int LedArray::scan_led_range(uint16_t delay_ms, float start_na, float end_na, bo
     Serial.print("ms\n  sequence_run_count: ");
     Serial.print(sequence_run_count);
     Serial.print(SERIAL_LINE_ENDING);
-    Serial.print("  trigger out 0 mode: ");
-    Serial.print(LedArray::trigger_output_mode_list[0]);
-    Serial.print(SERIAL_LINE_ENDING);
-    Serial.print("  trigger in 0 mode: ");
-    Serial.print(LedArray::trigger_input_mode_list[0]);
-    Serial.print(SERIAL_LINE_ENDING);
-    if (led_array_interface->trigger_output_count > 1)
-    {
-      Serial.print("  trigger out 1 mode: ");
-      Serial.print(LedArray::trigger_output_mode_list[1]);
-      Serial.print(SERIAL_LINE_ENDING);
-    }
-    if (led_array_interface->trigger_input_count > 1)
-    {
-      Serial.print("  trigger in 1 mode: ");
-      Serial.print(LedArray::trigger_input_mode_list[1]);
-      Serial.print(SERIAL_LINE_ENDING);
-    }
+    for (int trigger_index = 0; trigger_index < led_array_interface->trigger_output_count; trigger_index++)
+      Serial.printf("  trigger out %d mode: %d%s", trigger_index, LedArray::trigger_output_mode_list[trigger_index], SERIAL_LINE_ENDING);
+    for (int trigger_index = 0; trigger_index < led_array_interface->trigger_input_count; trigger_index++)
+      Serial.printf("  trigger in %d mode: %d%s", trigger_index, LedArray::trigger_input_mode_list[trigger_index], SERIAL_LINE_ENDING);
   }
 
   // Check to be sure we're not trying to go faster than the hardware will allow
@@ -1840,11 +2341,11 @@ int LedArray::scan_led_range(uint16_t delay_ms, float start_na, float end_na, bo
   {
     for (int16_t led_index = 0; led_index < (int16_t)led_array_interface->led_count; led_index++)
     {
-      d = sqrt(LedArrayInterface::led_position_list_na[led_index][0] * LedArrayInterface::led_position_list_na[led_index][0] + LedArrayInterface::led_position_list_na[led_index][1] * LedArrayInterface::led_position_list_na[led_index][1]);
+      d = LedArrayInterface::led_position_list_na_radius[led_index];
       if (d >= start_na && d <= end_na)
       {
         // Clear all LEDs
-        led_array_interface->clear();
+        led_array_interface->clear_frame();
 
         // Set LEDs
         for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
@@ -1857,7 +2358,8 @@ int LedArray::scan_led_range(uint16_t delay_ms, float start_na, float end_na, bo
             Serial.print(SERIAL_DELIMITER);
         }
 
-        // Update LED Pattern
+        // Update LED Pattern once the previous output pulses are finished
+        TriggerPulses::wait_all();
         led_array_interface->update();
 
         // Send trigger pulse
@@ -1889,6 +2391,9 @@ int LedArray::scan_led_range(uint16_t delay_ms, float start_na, float end_na, bo
 /* Command parser for DPC */
 int LedArray::draw_dpc(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   int8_t pattern_index = -1;
   float angle_deg = 0.0;
   if (argc == 1)
@@ -1920,7 +2425,7 @@ int LedArray::draw_dpc(uint16_t argc, char ** argv)
   }
 
   if (auto_clear_flag)
-    led_array_interface->clear();
+    led_array_interface->clear_frame();
 
 
   if (pattern_index >= 0)
@@ -1940,11 +2445,14 @@ int LedArray::draw_dpc(uint16_t argc, char ** argv)
 /* Draw brightfield pattern */
 int LedArray::draw_brightfield(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   if (debug_level)
     Serial.printf(F("Drawing brightfield pattern.%s"), SERIAL_LINE_ENDING);
 
   if (auto_clear_flag)
-    clear();
+    led_array_interface->clear_frame();
 
   // Draw circle
   draw_primative_circle(inner_na, objective_na);
@@ -1956,11 +2464,14 @@ int LedArray::draw_brightfield(uint16_t argc, char ** argv)
 /* Draw quadrant pattern */
 int LedArray::draw_quadrant(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   if (debug_level)
     Serial.printf(F("Drawing single quadrant pattern.%s"), SERIAL_LINE_ENDING);
 
   if (auto_clear_flag)
-    clear();
+    led_array_interface->clear_frame();
 
   int quadrant_index = 0;
   if (argc == 1)
@@ -1986,11 +2497,15 @@ int LedArray::set_custom_sequence_length(uint16_t argc, char ** argv)
     ; // do nothing
   if (argc == 2)
   {
+    if (timed_sequence_running)
+      return ERROR_SEQUENCE_RUNNING;
+
     // Reset old sequence
     LedArray::led_sequence.deallocate();
 
     // Initalize new sequence
-    LedArray::led_sequence.allocate(strtoul(argv[1], NULL, 0));
+    if (!LedArray::led_sequence.allocate(strtoul(argv[1], NULL, 0)))
+      return ERROR_MEMORY_ALLOC;
   }
   else
     return ERROR_ARGUMENT_COUNT;
@@ -2006,6 +2521,9 @@ int LedArray::set_custom_sequence_length(uint16_t argc, char ** argv)
 /* Set sequence value */
 int LedArray::set_custom_sequence_value(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
 
   if (argc < 2)
     return ERROR_ARGUMENT_COUNT;
@@ -2013,8 +2531,12 @@ int LedArray::set_custom_sequence_value(uint16_t argc, char ** argv)
   {
     if (!strcmp(argv[1], "range"))
     {
-      uint16_t range_start = strtoul(argv[2], NULL, 0);
-      uint16_t range_end = strtoul(argv[3], NULL, 0);
+      if (argc != 4)
+        return ERROR_ARGUMENT_COUNT;
+      uint32_t range_start = strtoul(argv[2], NULL, 0);
+      uint32_t range_end = strtoul(argv[3], NULL, 0);
+      if ((range_end > (uint32_t)led_array_interface->led_count) || (range_start > range_end))
+        return ERROR_ARGUMENT_RANGE;
       if (LedArray::led_sequence.increment(range_end - range_start))
         for (uint16_t index = range_start; index < range_end; index++)
           LedArray::led_sequence.append(index);
@@ -2026,27 +2548,16 @@ int LedArray::set_custom_sequence_value(uint16_t argc, char ** argv)
       float na_range_start = (float)atoi(argv[2]) / 100.0;
       float na_range_end = (float)atoi(argv[3]) / 100.0;
 
-      // Determine LED Count
-      uint16_t led_count = 0;
-      float led_na;
-      for (uint16_t index = 0; index < led_array_interface->led_count; index++)
-      {
-        led_na = sqrt(led_array_interface->led_position_list_na[index][0] * led_array_interface->led_position_list_na[index][0] \
-                      + led_array_interface->led_position_list_na[index][1] * led_array_interface->led_position_list_na[index][1]);
-        if ((led_na > na_range_start) && (led_na < na_range_end))
-          led_count++;
-      }
+      // LEDs in the (exclusive) NA range are contiguous in the sorted list
+      uint16_t first_index = find_na_index(na_range_start, false);
+      uint16_t last_index = find_na_index(na_range_end, true);
+      uint16_t led_count = (last_index > first_index) ? (last_index - first_index) : 0;
 
       // Increment pattern and add LEDs
       if (LedArray::led_sequence.increment(led_count))
       {
-        for (uint16_t index = 0; index < led_array_interface->led_count; index++)
-        {
-          led_na = sqrt(led_array_interface->led_position_list_na[index][0] * led_array_interface->led_position_list_na[index][0]
-                        + led_array_interface->led_position_list_na[index][1] * led_array_interface->led_position_list_na[index][1]);
-          if ((led_na > na_range_start) && (led_na < na_range_end))
-            LedArray::led_sequence.append(index);
-        }
+        for (uint16_t sorted_index = first_index; sorted_index < first_index + led_count; sorted_index++)
+          LedArray::led_sequence.append(LedArrayInterface::led_na_sorted_list[sorted_index]);
       }
       else
         return ERROR_SEQUENCE_FULL;
@@ -2066,6 +2577,10 @@ int LedArray::set_custom_sequence_value(uint16_t argc, char ** argv)
     }
     else
     {
+      for (uint16_t index = 1; index < argc; index++)
+        if (strtoul(argv[index], NULL, 0) >= (uint32_t)led_array_interface->led_count)
+          return ERROR_ARGUMENT_RANGE;
+
       if (LedArray::led_sequence.increment(argc - 1))
       {
         for (uint16_t index = 1; index < argc; index++)
@@ -2081,6 +2596,27 @@ int LedArray::set_custom_sequence_value(uint16_t argc, char ** argv)
   return NO_ERROR;
 }
 
+/* Set sequence value from packed LED indicies (binary command frames) */
+int LedArray::set_custom_sequence_value(uint16_t led_count, const uint16_t * led_list)
+{
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
+  for (uint16_t led_index = 0; led_index < led_count; led_index++)
+    if (led_list[led_index] >= led_array_interface->led_count)
+      return ERROR_ARGUMENT_RANGE;
+
+  if (!LedArray::led_sequence.increment(led_count))
+    return ERROR_SEQUENCE_FULL;
+
+  for (uint16_t led_index = 0; led_index < led_count; led_index++)
+    LedArray::led_sequence.append(led_list[led_index]);
+
+  // Print current sequence length
+  LedArray::led_sequence.print(LedArray::led_sequence.number_of_patterns_assigned - 1, command_mode);
+  return NO_ERROR;
+}
+
 int LedArray::print_custom_sequence(uint16_t argc, char ** argv)
 {
 
@@ -2093,6 +2629,9 @@ int LedArray::print_custom_sequence(uint16_t argc, char ** argv)
 /* Restart stored sequence */
 int LedArray::restart_custom_sequence(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   // Set pattern index to zero
   LedArray::pattern_index = 0;
 
@@ -2102,8 +2641,237 @@ int LedArray::restart_custom_sequence(uint16_t argc, char ** argv)
   return NO_ERROR;
 }
 
+/* Convert each sequence pattern to the LED driver values it produces, so that playback only needs to copy them.
+   Returns ERROR_NOT_SUPPORTED_BY_DEVICE if the device does not support this, or ERROR_SEQUENCE_FULL if the compiled
+   patterns do not fit. */
+int LedArray::compile_custom_sequence()
+{
+  uint16_t value_index = 0;
+  LedArray::led_sequence.compiled_offsets[0] = 0;
+
+  for (uint16_t pattern_index = 0; pattern_index < LedArray::led_sequence.number_of_patterns_assigned; pattern_index++)
+  {
+    const uint16_t * pattern_led_list = LedArray::led_sequence.get_led_list(pattern_index);
+    for (uint16_t led_idx = 0; led_idx < LedArray::led_sequence.get_led_count(pattern_index); led_idx++)
+    {
+      for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+      {
+        int32_t grayscale_index = led_array_interface->get_grayscale_index(pattern_led_list[led_idx], color_channel_index);
+        if (grayscale_index < 0)
+          return ERROR_NOT_SUPPORTED_BY_DEVICE;
+        if (value_index >= LED_SEQUENCE_MAX_COMPILED_VALUES)
+        {
+          Serial.print(F("Compiled sequence storage (")); Serial.print(LED_SEQUENCE_MAX_COMPILED_VALUES); Serial.printf(F(" values) is full at pattern %d.%s"), pattern_index, SERIAL_LINE_ENDING);
+          return ERROR_SEQUENCE_FULL;
+        }
+
+        // Draw the LED as usual (applying brightness and cosine weighting) and record the result
+        set_led(pattern_led_list[led_idx], color_channel_index, led_value[color_channel_index]);
+        LedArray::led_sequence.compiled_grayscale_indices[value_index] = (uint16_t)grayscale_index;
+        LedArray::led_sequence.compiled_values[value_index] = led_array_interface->get_grayscale_value(grayscale_index);
+        value_index++;
+      }
+    }
+    LedArray::led_sequence.compiled_offsets[pattern_index + 1] = value_index;
+  }
+
+  return NO_ERROR;
+}
+
+/* Copy a compiled pattern into the LED driver buffer (without updating) */
+void LedArray::draw_compiled_pattern(uint16_t pattern_index)
+{
+  uint16_t value_offset = LedArray::led_sequence.compiled_offsets[pattern_index];
+  led_array_interface->set_grayscale_values(LedArray::led_sequence.compiled_offsets[pattern_index + 1] - value_offset,
+                                            &LedArray::led_sequence.compiled_grayscale_indices[value_offset],
+                                            &LedArray::led_sequence.compiled_values[value_offset]);
+}
+
+/* Timer interrupt for timed sequences, which starts sending the next pattern. This must never wait: the DMA interrupt
+   which ends each transfer cannot preempt it, so output triggers are sent from that interrupt once the pattern is latched. */
+void LedArray::timed_sequence_interrupt()
+{
+  LedArray * led_array = timed_sequence_instance;
+
+  // If the previous pattern is still being sent, skip this period
+  if (Tlc5955Dma::is_busy())
+  {
+    timed_sequence_overrun_count++;
+    return;
+  }
+
+  if (timed_sequence_pattern_index >= LedArray::led_sequence.number_of_patterns_assigned)
+  {
+    timed_sequence_pattern_index = 0;
+    if (++timed_sequence_run_index >= timed_sequence_run_count)
+    {
+      // Finished, so clear the array after the last pattern has been shown for a full period
+      stop_timed_sequence();
+      led_array->led_array_interface->clear_frame();
+      led_array->led_array_interface->update_async();
+      return;
+    }
+  }
+
+  uint32_t trigger_mask = 0;
+  for (int trigger_index = 0; trigger_index < led_array->led_array_interface->trigger_output_count; trigger_index++)
+  {
+    if (((LedArray::trigger_output_mode_list[trigger_index] > 0) && (timed_sequence_pattern_index % LedArray::trigger_output_mode_list[trigger_index] == 0))
+        || ((LedArray::trigger_output_mode_list[trigger_index] == TRIG_MODE_ITERATION) && (timed_sequence_pattern_index == 0))
+        || ((LedArray::trigger_output_mode_list[trigger_index] == TRIG_MODE_START) && (timed_sequence_run_index == 0 && timed_sequence_pattern_index == 0)))
+      trigger_mask |= (1UL << trigger_index);
+  }
+  timed_sequence_trigger_mask = trigger_mask;
+
+  led_array->draw_compiled_pattern(timed_sequence_pattern_index);
+  led_array->led_array_interface->update_async();
+
+  // If no transfer was needed (the pattern is unchanged), the pattern is already latched
+  if (!Tlc5955Dma::is_busy())
+    send_timed_sequence_triggers();
+
+  timed_sequence_pattern_index++;
+}
+
+/* Sends the output triggers for the timed sequence pattern which was just latched (from the DMA interrupt) */
+void LedArray::send_timed_sequence_triggers()
+{
+  __disable_irq();
+  uint32_t trigger_mask = timed_sequence_trigger_mask;
+  timed_sequence_trigger_mask = 0;
+  __enable_irq();
+
+  for (int trigger_index = 0; trigger_mask != 0; trigger_index++, trigger_mask >>= 1)
+  {
+    // Never wait for a busy channel here, since interrupts must not block
+    if (trigger_mask & 1)
+      TriggerPulses::send(trigger_index, LedArrayInterface::trigger_output_pin_list[trigger_index],
+                          LedArray::trigger_output_pulse_width_list_us[trigger_index], 0, false, false);
+  }
+}
+
+/* Stops timed sequence playback, leaving the current pattern shown. This may be called from the timer interrupt. */
+void LedArray::stop_timed_sequence()
+{
+  sequence_timer.end();
+  timed_sequence_running = false;
+  timed_sequence_trigger_mask = 0;
+  Tlc5955Dma::set_latch_callback(NULL);
+  TriggerPulses::release_all();
+}
+
+/* Run the sequence from a hardware timer, with the pattern period given in microseconds.
+   This returns immediately, leaving the main loop free while the sequence plays. */
+int LedArray::run_custom_sequence_timed(uint16_t argc, char ** argv)
+{
+  if (argc == 2 && !strcmp(argv[1], "stop"))
+  {
+    stop_timed_sequence();
+    clear();
+  }
+  else if (argc == 2 || argc == 3)
+  {
+    uint32_t period_us = strtoul(argv[1], NULL, 0);
+    uint16_t sequence_run_count = 1;
+    if (argc == 3)
+      sequence_run_count = strtoul(argv[2], NULL, 0);
+
+    stop_timed_sequence();
+
+    if ((period_us == 0) || (sequence_run_count == 0) || (LedArray::led_sequence.number_of_patterns_assigned == 0))
+      return ERROR_INVALID_ARGUMENT;
+
+    // Input triggers would need to be waited for, which is not possible from the timer interrupt
+    for (int trigger_index = 0; trigger_index < led_array_interface->trigger_input_count; trigger_index++)
+    {
+      if (LedArray::trigger_input_mode_list[trigger_index] != TRIG_MODE_NONE)
+      {
+        Serial.printf(F("ERROR: Timed sequences do not support input triggers.%s"), SERIAL_LINE_ENDING);
+        return ERROR_TRIGGER_CONFIG;
+      }
+    }
+
+    // The strobe input is an input trigger too
+    if (Tlc5955Dma::get_strobe_input() >= 0)
+    {
+      Serial.printf(F("ERROR: Timed sequences do not support strobe mode.%s"), SERIAL_LINE_ENDING);
+      return ERROR_TRIGGER_CONFIG;
+    }
+
+    // Patterns are copied from the compiled sequence during playback
+    int compile_result = compile_custom_sequence();
+    if (compile_result != NO_ERROR)
+      return compile_result;
+
+    // Output triggers are sent from interrupts, which cannot wait for a free interval timer, so reserve them now
+    for (int trigger_index = 0; trigger_index < led_array_interface->trigger_output_count; trigger_index++)
+    {
+      if (LedArray::trigger_output_mode_list[trigger_index] == TRIG_MODE_NONE)
+        continue;
+
+      if ((led_array_interface->trigger_output_pin_list[trigger_index] <= 0) || !TriggerPulses::reserve(trigger_index))
+      {
+        Serial.printf(F("ERROR: Could not set up output trigger %d for a timed sequence (too many outputs in use?).%s"), trigger_index, SERIAL_LINE_ENDING);
+        TriggerPulses::release_all();
+        return ERROR_TRIGGER_CONFIG;
+      }
+    }
+    TriggerPulses::reset_dropped_count();
+
+    timed_sequence_instance = this;
+    timed_sequence_pattern_index = 0;
+    timed_sequence_run_index = 0;
+    timed_sequence_run_count = sequence_run_count;
+    timed_sequence_trigger_mask = 0;
+    timed_sequence_overrun_count = 0;
+    timed_sequence_running = true;
+    Tlc5955Dma::set_latch_callback(send_timed_sequence_triggers);
+
+    // Show the first pattern now, checking that each pattern can be sent and latched within the period
+    led_array_interface->wait_for_update();
+    elapsedMicros elapsed_us;
+    timed_sequence_interrupt();
+    led_array_interface->wait_for_update();
+    if ((uint32_t)elapsed_us >= period_us)
+    {
+      Serial.print("ERROR: Sequence period (");
+      Serial.print(period_us);
+      Serial.print("us) was shorter than the pattern update time (");
+      Serial.print((uint32_t)elapsed_us);
+      Serial.print("us).");
+      Serial.print(SERIAL_LINE_ENDING);
+      stop_timed_sequence();
+      clear();
+      return ERROR_SEQUENCE_DELAY;
+    }
+
+    if (!sequence_timer.begin(timed_sequence_interrupt, period_us))
+    {
+      Serial.printf(F("ERROR: No interval timer is free for the timed sequence.%s"), SERIAL_LINE_ENDING);
+      stop_timed_sequence();
+      clear();
+      return ERROR_TRIGGER_CONFIG;
+    }
+  }
+  else if (argc != 1)
+    return ERROR_ARGUMENT_COUNT;
+
+  // Print playback state
+  clear_output_buffers();
+  sprintf(output_buffer_short, "SEQ_TIMED.%d.%d.%d.%lu.%lu", timed_sequence_running, timed_sequence_run_index, timed_sequence_pattern_index,
+          (unsigned long)timed_sequence_overrun_count, (unsigned long)TriggerPulses::get_dropped_count());
+  snprintf(output_buffer_long, MAX_RESPONSE_LENGTH_LONG, "Timed sequence: running %d, iteration %d, pattern %d, %lu skipped, %lu pulses dropped", timed_sequence_running,
+           timed_sequence_run_index, timed_sequence_pattern_index, (unsigned long)timed_sequence_overrun_count, (unsigned long)TriggerPulses::get_dropped_count());
+  print(output_buffer_short, output_buffer_long);
+
+  return NO_ERROR;
+}
+
 int LedArray::run_custom_sequence(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
   // Parse Arguments
   uint16_t delay_ms = 500;
   uint16_t sequence_run_count = 1;
@@ -2123,24 +2891,10 @@ int LedArray::run_custom_sequence(uint16_t argc, char ** argv)
     Serial.print("ms\n  sequence_run_count: ");
     Serial.print(sequence_run_count);
     Serial.print(SERIAL_LINE_ENDING);
-    Serial.print("  trigger out 0 mode: ");
-    Serial.print(LedArray::trigger_output_mode_list[0]);
-    Serial.print(SERIAL_LINE_ENDING);
-    Serial.print("  trigger in 0 mode: ");
-    Serial.print(LedArray::trigger_input_mode_list[0]);
-    Serial.print(SERIAL_LINE_ENDING);
-    if (led_array_interface->trigger_output_count > 1)
-    {
-      Serial.print("  trigger out 1 mode: ");
-      Serial.print(LedArray::trigger_output_mode_list[1]);
-      Serial.print(SERIAL_LINE_ENDING);
-    }
-    if (led_array_interface->trigger_input_count > 1)
-    {
-      Serial.print("  trigger in 1 mode: ");
-      Serial.print(LedArray::trigger_input_mode_list[1]);
-      Serial.print(SERIAL_LINE_ENDING);
-    }
+    for (int trigger_index = 0; trigger_index < led_array_interface->trigger_output_count; trigger_index++)
+      Serial.printf("  trigger out %d mode: %d%s", trigger_index, LedArray::trigger_output_mode_list[trigger_index], SERIAL_LINE_ENDING);
+    for (int trigger_index = 0; trigger_index < led_array_interface->trigger_input_count; trigger_index++)
+      Serial.printf("  trigger in %d mode: %d%s", trigger_index, LedArray::trigger_input_mode_list[trigger_index], SERIAL_LINE_ENDING);
   }
 
   // Check to be sure we're not trying to go faster than the hardware will allow
@@ -2165,6 +2919,12 @@ int LedArray::run_custom_sequence(uint16_t argc, char ** argv)
     return ERROR_SEQUENCE_DELAY;
   }
 
+  // Compile patterns before playback where possible. Otherwise (including when the compiled patterns do not fit, which
+  // is reported), patterns are drawn as they are played.
+  bool sequence_compiled = (compile_custom_sequence() == NO_ERROR);
+  if (!sequence_compiled && debug_level)
+    Serial.printf(F("Sequence is not compiled, so patterns will be drawn during playback.%s"), SERIAL_LINE_ENDING);
+
   // Clear LED Array
   clear();
 
@@ -2172,6 +2932,12 @@ int LedArray::run_custom_sequence(uint16_t argc, char ** argv)
   uint16_t led_number;
   bool result = true;
 
+  // In strobe mode, each pattern is only latched while the strobe input shows the camera is exposing
+  bool strobe_mode = (Tlc5955Dma::get_strobe_input() >= 0);
+
+  // Trigger input edges seen before the sequence starts are stale
+  TriggerEdgeQueue::flush();
+
   // Clear serial buffer
   while (Serial.available())
     Serial.read();
@@ -2191,23 +2957,31 @@ int LedArray::run_custom_sequence(uint16_t argc, char ** argv)
 
       elapsedMicros elapsed_us_inner;
 
-      // Set all LEDs to zero
-      led_array_interface->clear();
-
-      // Define pattern
-      for (uint16_t led_idx = 0; led_idx < LedArray::led_sequence.led_counts[pattern_index]; led_idx++)
+      if (sequence_compiled)
+        draw_compiled_pattern(pattern_index);
+      else
       {
-        led_number = LedArray::led_sequence.led_list[pattern_index][led_idx];
-        for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
-          set_led(led_number, color_channel_index, led_value[color_channel_index]);
-      }
+        // Set all LEDs to zero
+        led_array_interface->clear_frame();
 
-      // Check if led_count is zero - if so, clear the array
-      if (LedArray::led_sequence.led_counts[pattern_index] == 0)
-        led_array_interface->clear();
+        // Define pattern
+        const uint16_t * pattern_led_list = LedArray::led_sequence.get_led_list(pattern_index);
+        uint16_t pattern_led_count = LedArray::led_sequence.get_led_count(pattern_index);
+        for (uint16_t led_idx = 0; led_idx < pattern_led_count; led_idx++)
+        {
+          led_number = pattern_led_list[led_idx];
+          for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
+            set_led(led_number, color_channel_index, led_value[color_channel_index]);
+        }
+      }
 
-      // Update pattern
-      led_array_interface->update();
+      // Update pattern once the previous output pulses (and their delays) are finished. This returns once the
+      // transfer has started, so the next pattern can be drawn while it is sent.
+      TriggerPulses::wait_all();
+      if (strobe_mode)
+        led_array_interface->update_strobed();
+      else
+        led_array_interface->update_async();
 
       // Ensure that we haven't set too short of a delay
       if ((float)elapsed_us_inner > (1000 * (float)delay_ms) && (delay_ms > 0))
@@ -2224,9 +2998,12 @@ int LedArray::run_custom_sequence(uint16_t argc, char ** argv)
             || ((LedArray::trigger_output_mode_list[trigger_index] == TRIG_MODE_ITERATION) && (pattern_index == 0))
             || ((LedArray::trigger_output_mode_list[trigger_index] == TRIG_MODE_START) && (sequence_index == 0 && pattern_index == 0)))
         {
+          // Only trigger once the pattern has been latched (or, in strobe mode, shifted in ready for the exposure)
+          if (strobe_mode)
+            while (Tlc5955Dma::is_busy()) {}
+          else
+            led_array_interface->wait_for_update();
           send_trigger_pulse(trigger_index, false);
-          if (LedArray::trigger_output_start_delay_list_us[trigger_index] > 0)
-            delayMicroseconds(LedArray::trigger_output_start_delay_list_us[trigger_index]);
         }
       }
 
@@ -2286,6 +3063,12 @@ int LedArray::run_custom_sequence(uint16_t argc, char ** argv)
 
 int LedArray::step_custom_sequence(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
+  // Trigger input edges seen before the sequence starts are stale
+  TriggerEdgeQueue::flush();
+
   Serial.printf(F("Stepping sequence %s"), SERIAL_LINE_ENDING);
 
 
@@ -2299,17 +3082,15 @@ int LedArray::step_custom_sequence(uint16_t argc, char ** argv)
   // Sent output trigger pulses before illuminating
   for (int trigger_index = 0; trigger_index < led_array_interface->trigger_output_count; trigger_index++)
   {
-    if (((LedArray::trigger_input_mode_list[trigger_index] > 0) && (LedArray::pattern_index % LedArray::trigger_input_mode_list[trigger_index] == 0))
+    if (((LedArray::trigger_output_mode_list[trigger_index] > 0) && (LedArray::pattern_index % LedArray::trigger_output_mode_list[trigger_index] == 0))
         || ((LedArray::trigger_output_mode_list[trigger_index] == TRIG_MODE_ITERATION) && (LedArray::pattern_index == 0))
         || ((LedArray::trigger_output_mode_list[trigger_index] == TRIG_MODE_START) && (LedArray::pattern_index == 0)))
-    {
       send_trigger_pulse(trigger_index, false);
-
-      if (LedArray::trigger_output_start_delay_list_us[trigger_index] > 0)
-        delayMicroseconds(LedArray::trigger_output_start_delay_list_us[trigger_index]);
-    }
   }
 
+  // Wait for output pulses and their delays to finish before illuminating
+  TriggerPulses::wait_all();
+
   // Wait for all devices to start acquiring (if input triggers are configured
   for (int trigger_index = 0; trigger_index < led_array_interface->trigger_input_count; trigger_index++)
   {
@@ -2328,12 +3109,13 @@ int LedArray::step_custom_sequence(uint16_t argc, char ** argv)
   elapsedMicros elapsed_us_inner;
 
   // Clear the array
-  led_array_interface->clear();
+  led_array_interface->clear_frame();
 
   // Send LEDs
-  for (uint16_t led_idx = 0; led_idx < LedArray::led_sequence.led_counts[LedArray::pattern_index]; led_idx++)
+  const uint16_t * pattern_led_list = LedArray::led_sequence.get_led_list(LedArray::pattern_index);
+  for (uint16_t led_idx = 0; led_idx < LedArray::led_sequence.get_led_count(LedArray::pattern_index); led_idx++)
   {
-    led_number = LedArray::led_sequence.led_list[LedArray::pattern_index][led_idx];
+    led_number = pattern_led_list[led_idx];
     for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
       set_led(led_number, color_channel_index, led_value[color_channel_index]);
   }
@@ -2373,6 +3155,12 @@ int LedArray::step_custom_sequence(uint16_t argc, char ** argv)
 
 int LedArray::run_sequence_dpc(uint16_t argc, char ** argv)
 {
+  if (timed_sequence_running)
+    return ERROR_SEQUENCE_RUNNING;
+
+  // Trigger input edges seen before the sequence starts are stale
+  TriggerEdgeQueue::flush();
+
   // Parse Arguments
   uint16_t delay_ms = 500;
   uint16_t sequence_run_count = 1;
@@ -2392,24 +3180,10 @@ int LedArray::run_sequence_dpc(uint16_t argc, char ** argv)
     Serial.print("ms\n  sequence_run_count: ");
     Serial.print(sequence_run_count);
     Serial.print(SERIAL_LINE_ENDING);
-    Serial.print("  trigger out 0 mode: ");
-    Serial.print(LedArray::trigger_output_mode_list[0]);
-    Serial.print(SERIAL_LINE_ENDING);
-    Serial.print("  trigger in 0 mode: ");
-    Serial.print(LedArray::trigger_input_mode_list[0]);
-    Serial.print(SERIAL_LINE_ENDING);
-    if (led_array_interface->trigger_output_count > 1)
-    {
-      Serial.print("  trigger out 1 mode: ");
-      Serial.print(LedArray::trigger_output_mode_list[1]);
-      Serial.print(SERIAL_LINE_ENDING);
-    }
-    if (led_array_interface->trigger_input_count > 1)
-    {
-      Serial.print("  trigger in 1 mode: ");
-      Serial.print(LedArray::trigger_input_mode_list[1]);
-      Serial.print(SERIAL_LINE_ENDING);
-    }
+    for (int trigger_index = 0; trigger_index < led_array_interface->trigger_output_count; trigger_index++)
+      Serial.printf("  trigger out %d mode: %d%s", trigger_index, LedArray::trigger_output_mode_list[trigger_index], SERIAL_LINE_ENDING);
+    for (int trigger_index = 0; trigger_index < led_array_interface->trigger_input_count; trigger_index++)
+      Serial.printf("  trigger in %d mode: %d%s", trigger_index, LedArray::trigger_input_mode_list[trigger_index], SERIAL_LINE_ENDING);
   }
 
   // Check to be sure we're not trying to go faster than the hardware will allow
@@ -2455,12 +3229,13 @@ int LedArray::run_sequence_dpc(uint16_t argc, char ** argv)
       elapsedMicros elapsed_us_inner;
 
       // Set all LEDs to zero
-      clear();
+      led_array_interface->clear_frame();
 
       // Draw half circle
       draw_primative_half_circle(dpc_pattern_angles[pattern_index], inner_na, objective_na);
 
-      // Update pattern
+      // Update pattern once the previous output pulses (and their delays) are finished
+      TriggerPulses::wait_all();
       led_array_interface->update();
 
       // Ensure that we haven't set too short of a delay
@@ -2478,8 +3253,6 @@ int LedArray::run_sequence_dpc(uint16_t argc, char ** argv)
             || ((LedArray::trigger_output_mode_list[trigger_index] == TRIG_MODE_START) && (sequence_index == 0 && pattern_index == 0)))
         {
           send_trigger_pulse(trigger_index, false);
-          if (LedArray::trigger_output_start_delay_list_us[trigger_index] > 0)
-            delayMicroseconds(LedArray::trigger_output_start_delay_list_us[trigger_index]);
         }
       }
 
@@ -2659,9 +3432,15 @@ int LedArray::print_power_supply_voltage(uint16_t argc, char ** argv)
 
 void LedArray::setup()
 {
+  // Trigger input edges are timestamped with the cycle counter
+  TriggerEdgeQueue::begin();
+
   // If setup has been run before, deallocate previous arrays to avoid memory leaks
   if (!initial_setup)
   {
+    // Strobe mode reads the input polarity list
+    Tlc5955Dma::set_strobe_input(-1, NULL);
+
     delete[] LedArray::trigger_output_pulse_width_list_us;
     delete[] LedArray::trigger_output_start_delay_list_us;
     delete[] LedArray::trigger_output_mode_list;
@@ -2685,7 +3464,6 @@ void LedArray::setup()
   LedArray::trigger_output_pulse_width_list_us = new uint32_t [led_array_interface->trigger_output_count];
   LedArray::trigger_output_start_delay_list_us = new uint32_t [led_array_interface->trigger_output_count];
   LedArray::trigger_output_mode_list = new int [led_array_interface->trigger_output_count];
-  LedArray::trigger_input_polarity_list = new bool [led_array_interface->trigger_output_count];
   LedArray::trigger_output_polarity_list = new bool [led_array_interface->trigger_output_count];
   for (uint16_t trigger_index = 0; trigger_index < led_array_interface->trigger_output_count; trigger_index++)
   {
@@ -2696,18 +3474,19 @@ void LedArray::setup()
     pinMode(led_array_interface->trigger_output_pin_list[trigger_index], OUTPUT);
   }
 
-  // Initialize output trigger settings
+  // Initialize input trigger settings
   LedArray::trigger_input_mode_list = new int [led_array_interface->trigger_input_count];
+  LedArray::trigger_input_polarity_list = new bool [led_array_interface->trigger_input_count];
   for (int trigger_index = 0; trigger_index < led_array_interface->trigger_input_count; trigger_index++)
   {
-    pinMode(led_array_interface->trigger_input_pin_list[trigger_index], INPUT);
     LedArray::trigger_input_polarity_list[trigger_index] = TRIGGER_INPUT_POLARITY_DEFAULT;
     LedArray::trigger_input_mode_list[trigger_index] = 0;
   }
+  update_trigger_input_interrupts();
 
   // Define led_value and led_color
-  led_brightness = led_brightness_default;
-  led_value = new uint8_t[led_array_interface->color_channel_count];
+  led_brightness = led_brightness_default * UINT8_TO_UINT16_SCALE;
+  led_value = new uint16_t[led_array_interface->color_channel_count];
   led_color = new uint8_t[led_array_interface->color_channel_count];
 
   // Populate led_color and led_value
@@ -2748,8 +3527,7 @@ void LedArray::setup()
     recall_parameters(true);
 
   // Set LED value based on color and brightness
-  for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
-    led_value[color_channel_index] = (uint8_t) ceil((float) led_color[color_channel_index] / (float) UINT8_MAX * (float) led_brightness);
+  update_led_value();
 
   // Update LED Pattern
   led_array_interface->update();
@@ -2782,8 +3560,8 @@ int LedArray::run_demo()
       for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
         led_value[color_channel_index] = 0;
 
-      led_value[color_channel_index_outer] = 16;
-      led_array_interface->clear();
+      led_value[color_channel_index_outer] = 16 * UINT8_TO_UINT16_SCALE;
+      led_array_interface->clear_frame();
       draw_primative_circle(0, objective_na);
       led_array_interface->update();
       delay(250);
@@ -2803,8 +3581,8 @@ int LedArray::run_demo()
       for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
         led_value[color_channel_index] = 0;
 
-      led_value[color_channel_index_outer] = 16;
-      led_array_interface->clear();
+      led_value[color_channel_index_outer] = 16 * UINT8_TO_UINT16_SCALE;
+      led_array_interface->clear_frame();
       draw_primative_circle(objective_na, objective_na + 0.2);
       led_array_interface->update();
       delay(250);
@@ -2826,8 +3604,8 @@ int LedArray::run_demo()
         for (int color_channel_index = 0; color_channel_index < led_array_interface->color_channel_count; color_channel_index++)
           led_value[color_channel_index] = 0;
 
-        led_value[color_channel_index_outer] = 16;
-        led_array_interface->clear();
+        led_value[color_channel_index_outer] = 16 * UINT8_TO_UINT16_SCALE;
+        led_array_interface->clear_frame();
         draw_primative_half_circle(dpc_pattern_angles[pattern_index], 0, objective_na);
         led_array_interface->update();
         delay(250);
@@ -2888,6 +3666,8 @@ int LedArray::set_sclk_baud_rate(uint16_t argc, char ** argv)
     ;
   else if (argc == 2)
   {
+    if (timed_sequence_running)
+      return ERROR_SEQUENCE_RUNNING;
     uint32_t new_baud_rate = (strtoul((char *) argv[1], NULL, 0));
     led_array_interface->set_sclk_baud_rate(new_baud_rate);
   }
@@ -2909,6 +3689,8 @@ int LedArray::set_gsclk_frequency(uint16_t argc, char ** argv)
     ;
   else if (argc == 2)
   {
+    if (timed_sequence_running)
+      return ERROR_SEQUENCE_RUNNING;
     uint32_t new_gsclk_frequency = (strtoul((char *) argv[1], NULL, 0));
     led_array_interface->set_gsclk_frequency(new_gsclk_frequency);
   }
@@ -2962,7 +3744,18 @@ int LedArray::set_led(int16_t led_number, int16_t color_channel_index, uint16_t
 
   // Apply cosine weighting
   if (cosine_factor != 0)
-    value = (uint16_t) (((float) value) * pow(1.0 / cos(asin(sqrt(LedArrayInterface::led_position_list_na[led_number][0] * LedArrayInterface::led_position_list_na[led_number][0] + LedArrayInterface::led_position_list_na[led_number][1] * LedArrayInterface::led_position_list_na[led_number][1]))), cosine_factor));
+  {
+    // Each LED has its own weighting, so set them one at a time
+    if (led_number < 0)
+    {
+      for (int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
+        set_led(led_index, color_channel_index, value);
+      return NO_ERROR;
+    }
+
+    uint64_t weighted_value = ((uint64_t)value * LedArrayInterface::led_cosine_gain_list[led_number]) >> COSINE_GAIN_FRACTIONAL_BITS;
+    value = (weighted_value > UINT16_MAX) ? UINT16_MAX : (uint16_t)weighted_value;
+  }
 
   led_array_interface->set_led(led_number, color_channel_index, value);
 
@@ -2974,7 +3767,18 @@ int LedArray::set_led(int16_t led_number, int16_t color_channel_index, uint8_t v
 
   // Apply cosine weighting
   if (cosine_factor != 0)
-    value = (uint8_t) (((float) value) * pow(1.0 / cos(asin(sqrt(LedArrayInterface::led_position_list_na[led_number][0] * LedArrayInterface::led_position_list_na[led_number][0] + LedArrayInterface::led_position_list_na[led_number][1] * LedArrayInterface::led_position_list_na[led_number][1]))), cosine_factor));
+  {
+    // Each LED has its own weighting, so set them one at a time
+    if (led_number < 0)
+    {
+      for (int16_t led_index = 0; led_index < led_array_interface->led_count; led_index++)
+        set_led(led_index, color_channel_index, value);
+      return NO_ERROR;
+    }
+
+    uint64_t weighted_value = ((uint64_t)value * LedArrayInterface::led_cosine_gain_list[led_number]) >> COSINE_GAIN_FRACTIONAL_BITS;
+    value = (weighted_value > UINT8_MAX) ? UINT8_MAX : (uint8_t)weighted_value;
+  }
 
   led_array_interface->set_led(led_number, color_channel_index, value);
 
@@ -3004,9 +3808,12 @@ int8_t LedArray::set_demo_mode(int8_t demo_mode)
 
 int8_t LedArray::store_parameters()
 {
+  // Brightness is stored as an 8-bit value, rounded up so that a dim 16-bit brightness is not stored as zero
+  uint8_t stored_brightness = (uint8_t) (((uint32_t)led_brightness + UINT8_TO_UINT16_SCALE - 1) / UINT8_TO_UINT16_SCALE);
+
   led_array_interface->set_register(STORED_NA_ADDRESS, (int8_t) round(objective_na * (float)INT8_MAX));
   led_array_interface->set_register(STORED_DISTANCE_ADDRESS, (uint8_t) led_array_distance_z);
-  led_array_interface->set_register(STORED_BRIGHTNESS_ADDRESS, (uint8_t) led_brightness);
+  led_array_interface->set_register(STORED_BRIGHTNESS_ADDRESS, stored_brightness);
 
   led_array_interface->set_register(STORED_COLOR_R_ADDRESS, led_color[0]);
   if (led_array_interface->color_channel_count == 3)
@@ -3023,7 +3830,7 @@ int8_t LedArray::store_parameters()
   // Print confirmation
   clear_output_buffers();
   sprintf(output_buffer_short, "STORE.OK");
-  sprintf(output_buffer_long, "Stored parameters:\n   objective_na: %.2f\n   led_array_distance_z: %.2f\n   led_brightness: %d", objective_na, led_array_distance_z, led_brightness);
+  sprintf(output_buffer_long, "Stored parameters:\n   objective_na: %.2f\n   led_array_distance_z: %.2f\n   led_brightness: %d", objective_na, led_array_distance_z, stored_brightness);
   print(output_buffer_short, output_buffer_long);
 
   return NO_ERROR;
@@ -3033,7 +3840,7 @@ int8_t LedArray::recall_parameters(bool quiet)
 {
   objective_na = (((float)led_array_interface->get_register(STORED_NA_ADDRESS)) / (float)INT8_MAX);
   led_array_distance_z = (float)led_array_interface->get_register(STORED_DISTANCE_ADDRESS);
-  led_brightness = (uint8_t)led_array_interface->get_register(STORED_BRIGHTNESS_ADDRESS);
+  led_brightness = (uint8_t)led_array_interface->get_register(STORED_BRIGHTNESS_ADDRESS) * UINT8_TO_UINT16_SCALE;
 
   // Set colors
   led_color[0] = (uint8_t)led_array_interface->get_register(STORED_COLOR_R_ADDRESS);
@@ -3053,7 +3860,7 @@ int8_t LedArray::recall_parameters(bool quiet)
   {
     clear_output_buffers();
     sprintf(output_buffer_short, "READ.OK");
-    sprintf(output_buffer_long, "Read parameters:\n   objective_na: %.2f\n   led_array_distance_z: %.2f\n   led_brightness: %d", objective_na, led_array_distance_z, led_brightness);
+    sprintf(output_buffer_long, "Read parameters:\n   objective_na: %.2f\n   led_array_distance_z: %.2f\n   led_brightness: %d", objective_na, led_array_distance_z, led_brightness / UINT8_TO_UINT16_SCALE);
     print(output_buffer_short, output_buffer_long);
   }
 
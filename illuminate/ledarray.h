@@ -37,6 +37,35 @@
 #include "constants.h"
 #include <Arduino.h>
 
+// Multiplier converting 8-bit brightness values to 16-bit (UINT16_MAX / UINT8_MAX)
+#define UINT8_TO_UINT16_SCALE 257
+
+// Cosine weighting gains are Q16 fixed point
+#define COSINE_GAIN_FRACTIONAL_BITS 16
+#define COSINE_GAIN_UNITY ((uint32_t)1 << COSINE_GAIN_FRACTIONAL_BITS)
+
+// Drawing primative types
+#define PRIMATIVE_QUADRANT 0
+#define PRIMATIVE_HALF_CIRCLE 1
+#define PRIMATIVE_CIRCLE 2
+
+// Number of drawing primatives kept in the pattern cache, and the largest LED count it supports
+#define PATTERN_CACHE_LENGTH 8
+#define PATTERN_CACHE_MAX_LED_COUNT 2048
+#define PATTERN_CACHE_MASK_WORDS (PATTERN_CACHE_MAX_LED_COUNT / 32)
+
+// The LEDs contained in a drawing primative, as a bitmask
+typedef struct pattern_cache_entry {
+  bool valid;
+  uint8_t primative;
+  float parameter;        // Quadrant number or half-circle angle
+  bool include_center;
+  float start_na;
+  float end_na;
+  uint32_t last_used;
+  uint32_t led_mask[PATTERN_CACHE_MASK_WORDS];
+} pattern_cache_entry_t;
+
 class LedArray {
   public:
 
@@ -49,6 +78,10 @@ class LedArray {
 
     // Pattern commands
     int draw_led_list(uint16_t argc, char ** argv);
+    int draw_led_list(uint16_t led_count, const uint16_t * led_list);
+    int draw_led_bitmask(uint16_t argc, char ** argv);
+    int draw_led_bitmask(const uint8_t * led_mask, uint16_t mask_byte_count);
+    int draw_led_frame(uint16_t value_count, const uint16_t * led_values);
     int draw_dpc(uint16_t argc, char ** argv);
     int draw_brightfield(uint16_t argc, char ** argv);;
     int draw_half_annulus(uint16_t argc, char * *argv);
@@ -74,6 +107,12 @@ class LedArray {
     int trigger_setup(uint16_t argc, char ** argv);
     int send_trigger_pulse(int trigger_index, bool show_output);
     bool wait_for_trigger_state(int trigger_index, bool state);
+    int print_trigger_latency(uint16_t argc, char ** argv);
+    int print_trigger_trace(uint16_t argc, char ** argv);
+    int set_strobe_input(uint16_t argc, char ** argv);
+
+    // Timing of drawing operations
+    int benchmark(uint16_t argc, char ** argv);
 
     // Setting system parameters
     int set_na(uint16_t argc, char ** argv);
@@ -83,14 +122,17 @@ class LedArray {
     int set_brightness(int16_t argc, char ** argv);
     int set_single_color(int16_t argc, char ** argv);
     void build_na_list(float boardDistance);
+    void build_cosine_gain_list();
     int set_auto_clear(uint16_t argc, char ** argv);
     int set_max_current_enforcement(uint16_t argc, char ** argv);
     int set_max_current_limit(uint16_t argc, char ** argv);
 
     // Custom sequences
     int run_custom_sequence(uint16_t argc, char ** argv);
+    int run_custom_sequence_timed(uint16_t argc, char ** argv);
     int step_custom_sequence(uint16_t argc, char ** argv);
     int set_custom_sequence_value(uint16_t argc, char ** argv);
+    int set_custom_sequence_value(uint16_t led_count, const uint16_t * led_list);
     int print_custom_sequence(uint16_t argc, char ** argv);
     int restart_custom_sequence(uint16_t argc, char ** argv);
     int set_custom_sequence_length(uint16_t argc, char ** argv);
@@ -163,6 +205,8 @@ class LedArray {
     int set_trigger_output_polarity(uint16_t argc, char ** argv);
     int get_trigger_input_pins(uint16_t argc, char ** argv);
     int get_trigger_output_pins(uint16_t argc, char ** argv);
+    int parse_trigger_index(uint16_t argc, char ** argv, int trigger_count, int * trigger_index);
+    template <typename T> void print_trigger_list(const char * command_name, const char * description, const volatile T * values, int trigger_count);
 
     int set_cosine_factor(uint16_t argc, char ** argv);
     void calculate_max_na();
@@ -204,8 +248,33 @@ class LedArray {
     // Defualt brightness
     const uint8_t LED_VALUE_DEFAULT = 10;
 
+    // Cache of recently drawn primatives
+    pattern_cache_entry_t pattern_cache[PATTERN_CACHE_LENGTH];
+    uint32_t pattern_cache_clock = 0;
+    bool is_led_in_primative(uint8_t primative, float parameter, bool include_center, float start_na, float end_na,
+                             float rotation_sin, float rotation_cos, int16_t led_index);
+    void draw_primative(uint8_t primative, float parameter, bool include_center, float start_na, float end_na);
+    void invalidate_pattern_cache();
+    uint16_t find_na_index(float na, bool include_equal);
+
     // LED sequence object for storage and retreival
     static LedSequence led_sequence;
+    int compile_custom_sequence();
+    void update_trigger_input_interrupts();
+    void draw_compiled_pattern(uint16_t pattern_index);
+
+    // Timer-driven sequence playback
+    static IntervalTimer sequence_timer;
+    static LedArray * timed_sequence_instance;
+    static volatile bool timed_sequence_running;
+    static volatile uint16_t timed_sequence_pattern_index;
+    static volatile uint16_t timed_sequence_run_index;
+    static volatile uint16_t timed_sequence_run_count;
+    static volatile uint32_t timed_sequence_trigger_mask;     // Output triggers to send once the current pattern is latched
+    static volatile uint32_t timed_sequence_overrun_count;    // Periods skipped because the previous pattern was still being sent
+    static void timed_sequence_interrupt();
+    static void send_timed_sequence_triggers();
+    static void stop_timed_sequence();
 
     // LED Controller Parameters
     boolean auto_clear_flag = true;
@@ -235,12 +304,12 @@ class LedArray {
     static volatile float trigger_input_timeout;
     static const int * trigger_output_pin_list;
     static const int * trigger_input_pin_list;
-    const float INPUT_TRIGGER_WAIT_PERIOD_US = 1;
 
     // Default illumination
-    uint8_t * led_value; // Current led values for each channel
+    uint16_t * led_value; // Current led values for each channel (16-bit)
     uint8_t * led_color;          // 8-bit color balance
-    uint8_t led_brightness;  // 8-bit brightness
+    uint16_t led_brightness;  // 16-bit brightness
+    void update_led_value();
 
     // Sequence stepping index
     uint16_t sequence_number_displayed = 0;
@@ -0,0 +1,210 @@
+/*
+  Copyright (c) 2021, Zack Phillips
+  Copyright (c) 2018, Zachary Phillips (UC Berkeley)
+  All rights reserved.
+
+  BSD 3-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+      Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+      Neither the name of the UC Berkley nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL ZACHARY PHILLIPS (UC BERKELEY) BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA , OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ledarrayinterface.h"
+#include "tlc5955dma.h"
+#include "triggeredges.h"
+#include "src/TLC5955/TLC5955.h"
+
+// Device-independent parts of LedArrayInterface. Everything else is implemented by the device files in src/ledarrays.
+
+// Copy of the grayscale data most recently latched (allocated when the first frame is latched)
+static uint16_t * latched_grayscale_data = NULL;
+static bool latched_grayscale_data_valid = false;
+
+/* Number of grayscale values for the whole chain of LED drivers */
+static uint32_t get_grayscale_value_count()
+{
+  return (uint32_t)TLC5955::chip_count * TLC5955::LEDS_PER_CHIP * TLC5955::COLOR_CHANNEL_COUNT;
+}
+
+/* Returns true if the grayscale data has not changed since it was last latched, so it does not need to be sent */
+bool LedArrayInterface::is_frame_latched()
+{
+  return latched_grayscale_data_valid
+         && (memcmp(latched_grayscale_data, TLC5955::_grayscale_data, get_grayscale_value_count() * sizeof(uint16_t)) == 0);
+}
+
+/* Records the grayscale data as latched, once it has been sent (or queued for DMA) */
+void LedArrayInterface::mark_frame_latched()
+{
+  if (latched_grayscale_data == NULL)
+    latched_grayscale_data = new uint16_t[get_grayscale_value_count()];
+  memcpy(latched_grayscale_data, TLC5955::_grayscale_data, get_grayscale_value_count() * sizeof(uint16_t));
+  latched_grayscale_data_valid = true;
+}
+
+/* Makes the next update send the frame, even if the grayscale data has not changed */
+void LedArrayInterface::invalidate_latched_frame()
+{
+  latched_grayscale_data_valid = false;
+}
+
+/* Clears the back buffer and latches the cleared frame */
+void LedArrayInterface::clear()
+{
+  clear_frame();
+  update();
+}
+
+/* Clears the back buffer (the LED driver grayscale data), without latching it */
+void LedArrayInterface::clear_frame()
+{
+  memset(TLC5955::_grayscale_data, 0, get_grayscale_value_count() * sizeof(uint16_t));
+}
+
+/* Queues the frame for DMA and returns, so the next frame can be drawn while this one is shifted in.
+   Without the global shutter (or without DMA) this falls back to a blocking update(). */
+void LedArrayInterface::update_async()
+{
+  if (!global_shutter_state)
+  {
+    update();
+    return;
+  }
+
+  if (is_frame_latched())
+    return;
+
+  // The grayscale data is copied into the DMA buffer, so it may be modified as soon as this returns
+  if (!Tlc5955Dma::update_async(get_sclk_baud_rate()))
+  {
+    update();
+    return;
+  }
+  mark_frame_latched();
+}
+
+void LedArrayInterface::update_strobed()
+{
+  if (!global_shutter_state)
+  {
+    update();
+    return;
+  }
+
+  // The strobe input latches this frame (and clears it again), so the latched data is no longer known
+  invalidate_latched_frame();
+  if (!Tlc5955Dma::shift_async(get_sclk_baud_rate()))
+    update();
+}
+
+void LedArrayInterface::wait_for_update()
+{
+  Tlc5955Dma::wait();
+}
+
+/* Writes every LED and color channel to the back buffer, without latching it */
+void LedArrayInterface::set_led_frame(const uint16_t * led_values)
+{
+  // Single-color devices number each driver output as a channel, while RGB devices have a value per color for each channel
+  uint16_t channel_stride = (color_channel_count == 1) ? 1 : TLC5955::COLOR_CHANNEL_COUNT;
+  uint16_t * grayscale_data = &TLC5955::_grayscale_data[0][0][0];
+  for (uint16_t led_index = 0; led_index < led_count; led_index++)
+  {
+    int16_t channel_number = led_channel_list[led_index];
+    if (channel_number < 0)
+      continue;
+    for (int color_channel_index = 0; color_channel_index < color_channel_count; color_channel_index++)
+      grayscale_data[channel_number * channel_stride + color_channel_index] = led_values[led_index * color_channel_count + color_channel_index];
+  }
+}
+
+/* Returns the grayscale buffer position of one LED color channel, or -1 if the LED is not connected */
+int32_t LedArrayInterface::get_grayscale_index(int16_t led_number, int16_t color_channel_number)
+{
+  int16_t channel_number = led_channel_list[led_number];
+  if (channel_number < 0)
+    return -1;
+
+  // Single-color devices drive each LED from one output, whatever color was asked for
+  if (color_channel_count == 1)
+    return channel_number;
+  if (color_channel_number < 0)
+    return -1;
+  return channel_number * TLC5955::COLOR_CHANNEL_COUNT + color_channel_number;
+}
+
+uint16_t LedArrayInterface::get_grayscale_value(uint16_t grayscale_index)
+{
+  return (&TLC5955::_grayscale_data[0][0][0])[grayscale_index];
+}
+
+/* Replaces the whole pattern in the back buffer, without latching it */
+void LedArrayInterface::set_grayscale_values(uint16_t value_count, const uint16_t * grayscale_indices, const uint16_t * values)
+{
+  uint16_t * grayscale_data = &TLC5955::_grayscale_data[0][0][0];
+  clear_frame();
+  for (uint16_t value_index = 0; value_index < value_count; value_index++)
+    grayscale_data[grayscale_indices[value_index]] = values[value_index];
+}
+
+/* Pulls every trigger input down, so inputs with nothing connected (such as spare GPIO pins) do not float */
+void LedArrayInterface::setup_trigger_inputs()
+{
+  for (int trigger_index = 0; trigger_index < trigger_input_count; trigger_index++)
+    pinMode(trigger_input_pin_list[trigger_index], INPUT_PULLDOWN);
+}
+
+/* Attaches or detaches the pin change interrupt of a trigger input. Interrupts are only attached to inputs in use,
+   so unused inputs cannot interrupt sequences. */
+void LedArrayInterface::set_trigger_input_interrupt(int trigger_index, bool enabled)
+{
+  if ((trigger_index < 0) || (trigger_index >= min(trigger_input_count, TRIGGER_CHANNEL_MAX)))
+    return;
+
+  int pin = trigger_input_pin_list[trigger_index];
+  if (enabled)
+  {
+    trigger_input_state[trigger_index] = digitalReadFast(pin);
+    attachInterrupt(digitalPinToInterrupt(pin), trigger_pin_interrupts[trigger_index], CHANGE);
+  }
+  else
+    detachInterrupt(digitalPinToInterrupt(pin));
+}
+
+/* Pin change interrupt for each trigger input, generated for every index up to TRIGGER_CHANNEL_MAX */
+template <uint8_t trigger_index>
+void LedArrayInterface::trigger_pin_interrupt()
+{
+  bool previous_state = trigger_input_state[trigger_index];
+  trigger_input_state[trigger_index] = digitalReadFast(trigger_input_pin_list[trigger_index]);
+  Tlc5955Dma::trigger_edge(trigger_index, trigger_input_state[trigger_index]);
+  TriggerEdgeQueue::push(trigger_index, trigger_input_state[trigger_index]);
+  bool new_state = trigger_input_state[trigger_index];
+  if (debug >= 2)
+    Serial.printf("Recieved trigger pulse on pin %d. Previous state: %s New state: %s%s", trigger_index, previous_state ? "HIGH" : "LOW", new_state ? "HIGH" : "LOW", SERIAL_LINE_ENDING);
+}
+
+void (* const LedArrayInterface::trigger_pin_interrupts[TRIGGER_CHANNEL_MAX])() = {
+  trigger_pin_interrupt<0>, trigger_pin_interrupt<1>, trigger_pin_interrupt<2>, trigger_pin_interrupt<3>,
+  trigger_pin_interrupt<4>, trigger_pin_interrupt<5>, trigger_pin_interrupt<6>, trigger_pin_interrupt<7>
+};
+static_assert(TRIGGER_CHANNEL_MAX == 8, "LedArrayInterface::trigger_pin_interrupts must have an entry for each trigger channel");
@@ -46,20 +46,39 @@ class LedArrayInterface {
     void set_led(int16_t led_number, int16_t color_channel_index, uint16_t value);     // LED brightness (16-bit)
     void set_led(int16_t led_number, int16_t color_channel_index, uint8_t value);      // LED brightness (8-bit)
     void set_led(int16_t led_number, int16_t color_channel_index, bool value);         // LED brightness (boolean)
+    void set_led_frame(const uint16_t * led_values);                                     // Every LED and color channel (16-bit), without updating
+
+    // Direct access to the LED driver grayscale buffer, used to play compiled sequences
+    int32_t get_grayscale_index(int16_t led_number, int16_t color_channel_index);         // Returns -1 if not supported
+    uint16_t get_grayscale_value(uint16_t grayscale_index);
+    void set_grayscale_values(uint16_t value_count, const uint16_t * grayscale_indices, const uint16_t * values); // Clears other LEDs, without updating
 
     // Get LED Value
     uint16_t get_led_value(uint16_t led_number, int color_channel_index);
 
-    // Clear array
+    // Clear array. clear() latches the cleared frame, while clear_frame() only clears the back buffer.
     static void clear();
+    static void clear_frame();
 
-    // Get and set trigger state
-    int send_trigger_pulse(int trigger_index, uint16_t delay_us, bool inverse_polarity);
-    static void trigger_pin_interrupt_0();
-    static void trigger_pin_interrupt_1();
+    // Trigger inputs (trigger outputs are pulsed by TriggerPulses)
+    static void setup_trigger_inputs();
+    static void set_trigger_input_interrupt(int trigger_index, bool enabled);
+    template <uint8_t trigger_index> static void trigger_pin_interrupt();
+    static void (* const trigger_pin_interrupts[TRIGGER_CHANNEL_MAX])();  // trigger_pin_interrupt for each trigger input
 
-    // Update array
+    // Update array. Drawing functions write to a back buffer (the LED driver grayscale data), which is only shown
+    // once update() copies it to the front buffer and latches it, so partially drawn patterns are never displayed.
     static void update();
+    static void update_async(); // Returns once the frame is queued for DMA, latching when the transfer completes
+    static void wait_for_update();
+    static void update_strobed(); // Shifts the frame in without latching it, so the strobe input latches it (see Tlc5955Dma)
+
+    // The chips are daisy-chained, so every chip must be shifted for any change. Updates skip frames which are unchanged
+    // since they were last latched, and changes which affect the chips without changing the frame (e.g. pin order or
+    // clocks) invalidate the latched frame so the next update is always sent.
+    static bool is_frame_latched();
+    static void mark_frame_latched();
+    static void invalidate_latched_frame();
 
     // Debug
     bool get_debug();
@@ -108,6 +127,9 @@ class LedArrayInterface {
     // Debug flag
     static int debug;
 
+    // Global shutter state (latching every update at once, rather than as each chip is shifted)
+    static bool global_shutter_state;
+
     // Triggering Variables
     static const int trigger_output_pin_list[];
     static const int trigger_input_pin_list[];
@@ -117,6 +139,10 @@ class LedArrayInterface {
     static const int16_t PROGMEM led_positions[][5];
     static const int16_t PROGMEM arbitrary_led_list[][1];
     static float led_position_list_na[][2];
+    static float led_position_list_na_radius[];  // Radial NA of each LED, computed with led_position_list_na
+    static uint16_t led_na_sorted_list[];        // LED indicies in order of increasing radial NA
+    static uint32_t led_cosine_gain_list[];      // Cosine weighting gain of each LED (Q16), computed by LedArray
+    static int16_t led_channel_list[];          // Driver channel of each LED, copied from led_positions in device_setup
 
     // Device-specific commands
     uint8_t get_device_command_count();
@@ -134,7 +160,7 @@ class LedArrayInterface {
 
     // Hardware-related functions
     void set_sclk_baud_rate(uint32_t new_baud_rate);
-    uint32_t get_sclk_baud_rate();
+    static uint32_t get_sclk_baud_rate();
     void set_gsclk_frequency(uint32_t new_gsclk_freq);
     uint32_t get_gsclk_frequency();
     void set_global_shutter_state(bool state);
@@ -36,36 +36,74 @@
 #include "ledarrayinterface.h"
 #include "constants.h"
 
+// Sequences are stored in a fixed pool, sized for the available RAM. On Teensy 4.x the pool (240 KB) is kept in RAM2
+// (DMAMEM), leaving the tightly coupled RAM1 for the stack and variables. The Teensy 3.2 has 64 KB of RAM in total, so
+// its pool is kept to 7.5 KB.
+#if defined(__IMXRT1062__)
+#define LED_SEQUENCE_MAX_PATTERNS 8192            // Maximum number of patterns in a sequence
+#define LED_SEQUENCE_MAX_LEDS 65536               // Maximum total number of LEDs over all patterns
+#define LED_SEQUENCE_MAX_COMPILED_VALUES 16384    // Maximum total number of LED channel values over all compiled patterns
+#define LED_SEQUENCE_MEMORY DMAMEM
+#else
+#define LED_SEQUENCE_MAX_PATTERNS 256
+#define LED_SEQUENCE_MAX_LEDS 2048
+#define LED_SEQUENCE_MAX_COMPILED_VALUES 512
+#define LED_SEQUENCE_MEMORY
+#endif
+
 // Define LED Sequence Object
+// Patterns are stored in compressed sparse row form: the LEDs of every pattern are packed end-to-end in led_pool,
+// and pattern i occupies led_pool[pattern_offsets[i]] to led_pool[pattern_offsets[i + 1] - 1].
+// The pool is static (there is only one sequence), so it can be placed in LED_SEQUENCE_MEMORY, which is not zeroed at
+// startup on Teensy 4.x.
 struct LedSequence
 {
   uint16_t length = 0;                      // Length of values
-  volatile uint16_t * led_counts;           // Number of LEDs in each values
-  volatile uint16_t * * led_list;           // LED numbers used in each entry
+  static uint16_t led_pool[LED_SEQUENCE_MAX_LEDS];                 // LED numbers used in each pattern
+  static uint32_t pattern_offsets[LED_SEQUENCE_MAX_PATTERNS + 1];  // Start of each pattern in led_pool
+
+  // Compiled patterns, stored the same way. Each entry is a value to write to the LED driver grayscale buffer.
+  static uint16_t compiled_grayscale_indices[LED_SEQUENCE_MAX_COMPILED_VALUES];
+  static uint16_t compiled_values[LED_SEQUENCE_MAX_COMPILED_VALUES];
+  static uint16_t compiled_offsets[LED_SEQUENCE_MAX_PATTERNS + 1];
   volatile uint16_t number_of_patterns_assigned = 0; // Number of patterns which have been assigned
   volatile uint16_t current_pattern_led_index = 0;   // Current led index within current pattern
   uint8_t color_channel_count = 1;
   uint8_t bit_depth = 8;
   int debug = 1;
 
+  LedSequence()
+  {
+    deallocate();
+  }
+
   void reset()
   {
     deallocate();
   }
 
-  void allocate(uint16_t values_length)
+  bool allocate(uint16_t values_length)
   {
-    led_list = new volatile uint16_t * [values_length];
-    led_counts = new volatile uint16_t [values_length];
+    if (values_length > LED_SEQUENCE_MAX_PATTERNS)
+    {
+      Serial.print(F("Sequence length (")); Serial.print(values_length); Serial.print(F(") is larger than the maximum (")); Serial.print(LED_SEQUENCE_MAX_PATTERNS); Serial.printf(F(").%s"), SERIAL_LINE_ENDING);
+      length = 0;
+      return false;
+    }
 
     // Assign new vector length
     length = values_length;
+    return true;
   }
 
   void append(uint16_t led_number)
   {
+    // Ignore LEDs beyond the count given to increment
+    if (pattern_offsets[number_of_patterns_assigned - 1] + current_pattern_led_index >= pattern_offsets[number_of_patterns_assigned])
+      return;
+
     // Assign led number
-    led_list[number_of_patterns_assigned - 1][current_pattern_led_index] = led_number;
+    led_pool[pattern_offsets[number_of_patterns_assigned - 1] + current_pattern_led_index] = led_number;
 
     // Increment number of LEDs stored in this pattern
     current_pattern_led_index++;
@@ -73,44 +111,48 @@ struct LedSequence
 
   bool increment(uint16_t led_count)
   {
-    if (number_of_patterns_assigned < length)
+    if (number_of_patterns_assigned >= length)
     {
-      // increment number of patterns assigned
-      number_of_patterns_assigned++;
-
-      // store the number of leds in this pattern
-      led_counts[number_of_patterns_assigned - 1] = led_count;
-
-      if (led_count > 0)
-        led_list[number_of_patterns_assigned - 1] = new uint16_t[led_count];
-
-      // Reset the pattern led index
-      current_pattern_led_index = 0;
-
-      // Let user know we haven't reached capacity
-      return true;
+      Serial.print(F("Sequence length (")); Serial.print(length); Serial.printf(F(") reached. %s"), SERIAL_LINE_ENDING);
+      return false;
     }
-    else
+
+    if (pattern_offsets[number_of_patterns_assigned] + led_count > LED_SEQUENCE_MAX_LEDS)
     {
-      Serial.print(F("Sequence length (")); Serial.print(length); Serial.printf(F(") reached. %s"), SERIAL_LINE_ENDING);
+      Serial.print(F("Sequence LED storage (")); Serial.print(LED_SEQUENCE_MAX_LEDS); Serial.printf(F(" LEDs) is full. %s"), SERIAL_LINE_ENDING);
       return false;
     }
+
+    // Reserve space for this pattern at the end of the pool
+    pattern_offsets[number_of_patterns_assigned + 1] = pattern_offsets[number_of_patterns_assigned] + led_count;
+
+    // increment number of patterns assigned
+    number_of_patterns_assigned++;
+
+    // Reset the pattern led index
+    current_pattern_led_index = 0;
+
+    // Let user know we haven't reached capacity
+    return true;
   }
 
   void deallocate()
   {
-    for (uint16_t values_index = 0; values_index < number_of_patterns_assigned; values_index++)
-      if (led_counts[values_index] > 0)
-        delete[] led_list[values_index];
-
-    if (number_of_patterns_assigned > 0)
-    {
-      delete[] led_list;
-      delete[] led_counts;
-    }
-
     number_of_patterns_assigned = 0;
     current_pattern_led_index = 0;
+    pattern_offsets[0] = 0;
+  }
+
+  // Number of LEDs in a pattern
+  uint16_t get_led_count(uint16_t pattern_index)
+  {
+    return pattern_offsets[pattern_index + 1] - pattern_offsets[pattern_index];
+  }
+
+  // LED numbers of a pattern
+  const uint16_t * get_led_list(uint16_t pattern_index)
+  {
+    return &led_pool[pattern_offsets[pattern_index]];
   }
 
   void print(int command_mode)
@@ -137,13 +179,13 @@ struct LedSequence
       Serial.print("Pattern ");
       Serial.print(pattern_index);
       Serial.print(" (");
-      Serial.print(led_counts[pattern_index]);
+      Serial.print(get_led_count(pattern_index));
       Serial.printf(" leds):");
-      for (uint16_t led_index = 0; led_index < led_counts[pattern_index]; led_index++)
+      for (uint16_t led_index = 0; led_index < get_led_count(pattern_index); led_index++)
       {
         Serial.print(F(" "));
-        Serial.print(led_list[pattern_index][led_index]);
-        if (led_index < led_counts[pattern_index] - 1)
+        Serial.print(get_led_list(pattern_index)[led_index]);
+        if (led_index < get_led_count(pattern_index) - 1)
           Serial.printf(F(","));
       }
       Serial.print(SERIAL_LINE_ENDING);
@@ -151,10 +193,10 @@ struct LedSequence
     else
     {
       Serial.print("[");
-      for (uint16_t led_index = 0; led_index < led_counts[pattern_index]; led_index++)
+      for (uint16_t led_index = 0; led_index < get_led_count(pattern_index); led_index++)
       {
-        Serial.print(led_list[pattern_index][led_index]);
-        if (led_index < led_counts[pattern_index] - 1)
+        Serial.print(get_led_list(pattern_index)[led_index]);
+        if (led_index < get_led_count(pattern_index) - 1)
           Serial.printf(F(","), SERIAL_LINE_ENDING);
       }
       if (pattern_index < number_of_patterns_assigned - 1)
@@ -46,7 +46,7 @@
 #endif
 
 // Global shutter state
-bool global_shutter_state = true;
+bool LedArrayInterface::global_shutter_state = true;
 
 // Power sensing pin
 const int POWER_SENSE_PIN = 23;
@@ -89,6 +89,10 @@ const int LedArrayInterface::bit_depth = 16;
 const bool LedArrayInterface::supports_fast_sequence = false;
 const float LedArrayInterface::led_array_distance_z_default = 60.0;
 float LedArrayInterface::led_position_list_na[LedArrayInterface::led_count][2];
+float LedArrayInterface::led_position_list_na_radius[LedArrayInterface::led_count];
+uint16_t LedArrayInterface::led_na_sorted_list[LedArrayInterface::led_count];
+uint32_t LedArrayInterface::led_cosine_gain_list[LedArrayInterface::led_count];
+int16_t LedArrayInterface::led_channel_list[LedArrayInterface::led_count];
 
 const int LedArrayInterface::trigger_output_pin_list[] = {TRIGGER_OUTPUT_PIN_0, TRIGGER_OUTPUT_PIN_1};
 const int LedArrayInterface::trigger_input_pin_list[] = {TRIGGER_INPUT_PIN_0, TRIGGER_INPUT_PIN_1};
@@ -107,6 +111,7 @@ uint16_t TLC5955::_grayscale_data[TLC5955::chip_count][TLC5955::LEDS_PER_CHIP][T
 
 /**** Device-specific variables ****/
 TLC5955 tlc; // TLC5955 object
+
 uint32_t gsclk_frequency = 5000000;
 
 /**** Device-specific commands ****/
@@ -727,6 +732,8 @@ void LedArrayInterface::set_max_current_limit(float limit)
 
 void LedArrayInterface::set_pin_order(int16_t led_number, int16_t color_channel_index, uint8_t position)
 {
+        // The pin order changes the bits sent for the same grayscale data, so always send the next frame
+        invalidate_latched_frame();
         tlc.set_pin_order_single(led_number, color_channel_index, position);
 }
 
@@ -739,7 +746,7 @@ void LedArrayInterface::not_implemented(const char * command_name)
 
 uint16_t LedArrayInterface::get_led_value(uint16_t led_number, int color_channel_index)
 {
-        int16_t channel_number = (int16_t)pgm_read_word(&(led_positions[led_number][1]));
+        int16_t channel_number = led_channel_list[led_number];
         if (channel_number >= 0)
                 return tlc.getChannelValue(channel_number, color_channel_index);
         else
@@ -778,34 +785,6 @@ int LedArrayInterface::(int input_trigger_index)
                 return (-1);
 }
 
-int LedArrayInterface::send_trigger_pulse(int trigger_index, uint16_t delay_us, bool inverse_polarity)
-{
-        // Get trigger pin
-        int trigger_pin = trigger_output_pin_list[trigger_index];
-
-        if (trigger_pin > 0)
-        {
-                // Write active state
-                if (inverse_polarity)
-                        digitalWriteFast(trigger_pin, LOW);
-                else
-                        digitalWriteFast(trigger_pin, HIGH);
-
-                // Delay if desired
-                if (delay_us > 0)
-                        delayMicroseconds(delay_us);
-
-                // Write normal state
-                if (inverse_polarity)
-                        digitalWriteFast(trigger_pin, HIGH);
-                else
-                        digitalWriteFast(trigger_pin, LOW);
-                return (1);
-        } else {
-                return (-1);
-        }
-}
-
 void LedArrayInterface::set_global_shutter_state(bool state)
 {
     if (debug >= 1)
@@ -838,15 +817,18 @@ bool LedArrayInterface::get_global_shutter_state()
 void LedArrayInterface::update()
 {
     if (global_shutter_state)
+    {
+        if (is_frame_latched())
+            return;
+
         tlc.update();
+        mark_frame_latched();
+    }
     else
+    {
         tlc.clear_without_modifying_pattern();
-}
-
-void LedArrayInterface::clear()
-{
-        tlc.set_all(0);
-        update();
+        invalidate_latched_frame();
+    }
 }
 
 void LedArrayInterface::set_channel(int16_t channel_number, int16_t color_channel_number, uint16_t value)
@@ -907,13 +889,13 @@ void LedArrayInterface::set_led(int16_t led_number, int16_t color_channel_number
         {
                 for (uint16_t led_index = 0; led_index < led_count; led_index++)
                 {
-                        int16_t channel_number = (int16_t)pgm_read_word(&(led_positions[led_index][1]));
+                        int16_t channel_number = led_channel_list[led_index];
                         set_channel(channel_number, color_channel_number, value);
                 }
         }
         else
         {
-                int16_t channel_number = (int16_t)pgm_read_word(&(led_positions[led_number][1]));
+                int16_t channel_number = led_channel_list[led_number];
                 set_channel(channel_number, color_channel_number, value);
         }
 }
@@ -992,6 +974,13 @@ void LedArrayInterface::set_part_number(uint16_t part_number)
 
 void LedArrayInterface::device_setup()
 {
+        // Cache the channel of each LED in RAM, rather than reading led_positions from flash on every update
+        for (uint16_t led_index = 0; led_index < led_count; led_index++)
+                led_channel_list[led_index] = (int16_t)pgm_read_word(&(led_positions[led_index][1]));
+
+        // The chips may have been reset, so always latch the next frame
+        invalidate_latched_frame();
+
         // Initialize TLC5955
         tlc.init(LAT, SPI_MOSI, SPI_CLK, GSCLK);
 
@@ -1273,6 +1262,8 @@ uint16_t LedArrayInterface::get_device_command_led_list_element(int device_comma
 
 void LedArrayInterface::set_gsclk_frequency(uint32_t gsclk_frequency)
 {
+  // Always send the next frame after a clock change
+  invalidate_latched_frame();
   tlc.set_gsclk_frequency(gsclk_frequency);
 }
 
@@ -1283,6 +1274,8 @@ uint32_t LedArrayInterface::get_gsclk_frequency()
 
 void LedArrayInterface::set_sclk_baud_rate(uint32_t new_baud_rate)
 {
+  // Always send the next frame after a clock change
+  invalidate_latched_frame();
   tlc.set_sclk_frequency(new_baud_rate);
 }
 
@@ -34,9 +34,11 @@
 #ifdef USE_SCI_ASYM_ARRAY
 #include "../../ledarrayinterface.h"
 #include "../TLC5955/TLC5955.h"
+#include "../../tlc5955dma.h"
+#include "../../triggeredges.h"
 
 // Global shutter state
-bool global_shutter_state = true;
+bool LedArrayInterface::global_shutter_state = true;
 
 // Pin definitions (used internally)
 const int GSCLK = 6;
@@ -74,6 +76,10 @@ const int LedArrayInterface::trigger_output_pin_list[] = {TRIGGER_OUTPUT_PIN_0,
 const int LedArrayInterface::trigger_input_pin_list[] = {TRIGGER_INPUT_PIN_0, TRIGGER_INPUT_PIN_1};
 bool LedArrayInterface::trigger_input_state[] = {false, false};
 float LedArrayInterface::led_position_list_na[LedArrayInterface::led_count][2];
+float LedArrayInterface::led_position_list_na_radius[LedArrayInterface::led_count];
+uint16_t LedArrayInterface::led_na_sorted_list[LedArrayInterface::led_count];
+uint32_t LedArrayInterface::led_cosine_gain_list[LedArrayInterface::led_count];
+int16_t LedArrayInterface::led_channel_list[LedArrayInterface::led_count];
 
 const uint8_t TLC5955::chip_count = 100;    // Change to reflect number of TLC chips
 float TLC5955::max_current_amps = 10.0;      // Maximum current output, amps
@@ -171,6 +177,8 @@ void LedArrayInterface::set_max_current_limit(float limit)
 
 void LedArrayInterface::set_pin_order(int16_t led_number, int16_t color_channel_index, uint8_t position)
 {
+        // The pin order changes the bits sent for the same grayscale data, so always send the next frame
+        invalidate_latched_frame();
         tlc.set_pin_order_single(led_number, color_channel_index, position);
 }
 
@@ -183,7 +191,7 @@ void LedArrayInterface::not_implemented(const char * command_name)
 
 uint16_t LedArrayInterface::get_led_value(uint16_t led_number, int color_channel_index)
 {
-        int16_t channel_number = (int16_t)pgm_read_word(&(led_positions[led_number][1]));
+        int16_t channel_number = led_channel_list[led_number];
         if (channel_number >= 0)
                 return tlc.get_single_channel(channel_number);
         else
@@ -207,34 +215,6 @@ void LedArrayInterface::set_debug(int state)
         Serial.printf(F("(LedArrayInterface::set_debug): Set debug level to %d \n"), debug);
 }
 
-int LedArrayInterface::send_trigger_pulse(int trigger_index, uint16_t delay_us, bool inverse_polarity)
-{
-        // Get trigger pin
-        int trigger_pin = trigger_output_pin_list[trigger_index];
-
-        if (trigger_pin > 0)
-        {
-                // Write active state
-                if (inverse_polarity)
-                        digitalWriteFast(trigger_pin, LOW);
-                else
-                        digitalWriteFast(trigger_pin, HIGH);
-
-                // Delay if desired
-                if (delay_us > 0)
-                        delayMicroseconds(delay_us);
-
-                // Write normal state
-                if (inverse_polarity)
-                        digitalWriteFast(trigger_pin, HIGH);
-                else
-                        digitalWriteFast(trigger_pin, LOW);
-                return (1);
-        } else {
-                return (-1);
-        }
-}
-
 void LedArrayInterface::set_global_shutter_state(bool state)
 {
     if (debug >= 1)
@@ -266,16 +246,23 @@ bool LedArrayInterface::get_global_shutter_state()
 
 void LedArrayInterface::update()
 {
+    // Let any DMA transfer finish first, so updates are latched in order
+    Tlc5955Dma::wait();
+
     if (global_shutter_state)
+    {
+        if (is_frame_latched())
+            return;
+
         tlc.update();
+        TriggerTrace::record(TRIGGER_TRACE_LATCH, 0, true);
+        mark_frame_latched();
+    }
     else
+    {
         tlc.clear_without_modifying_pattern();
-}
-
-void LedArrayInterface::clear()
-{
-        tlc.set_all(0);
-        update();
+        invalidate_latched_frame();
+    }
 }
 
 
@@ -331,15 +318,22 @@ void LedArrayInterface::set_led(int16_t led_number, int16_t color_channel_number
         }
         if (led_number < 0)
         {
+            // Whole-array writes go straight to the grayscale buffer
+            uint16_t * grayscale_data = &TLC5955::_grayscale_data[0][0][0];
             for (uint16_t led_index = 0; led_index < led_count; led_index++)
             {
-                    int16_t channel_number = (int16_t)pgm_read_word(&(led_positions[led_index][1]));
-                    set_channel(channel_number, color_channel_number, value);
+                if (led_channel_list[led_index] < 0)
+                    continue;
+                uint16_t * led_grayscale_data = &grayscale_data[led_channel_list[led_index] * TLC5955::COLOR_CHANNEL_COUNT];
+                if (color_channel_number < 0)
+                    led_grayscale_data[0] = led_grayscale_data[1] = led_grayscale_data[2] = value;
+                else
+                    led_grayscale_data[color_channel_number] = value;
             }
         }
         else
         {
-            int16_t channel_number = (int16_t)pgm_read_word(&(led_positions[led_number][1]));
+            int16_t channel_number = led_channel_list[led_number];
             set_channel(channel_number, color_channel_number, value);
         }
 }
@@ -379,8 +373,16 @@ int8_t LedArrayInterface::device_reset()
 
 int8_t LedArrayInterface::device_setup()
 {
+        // Cache the channel of each LED in RAM, rather than reading led_positions from flash on every update
+        for (uint16_t led_index = 0; led_index < led_count; led_index++)
+                led_channel_list[led_index] = (int16_t)pgm_read_word(&(led_positions[led_index][1]));
+
+        // The chips may have been reset, so always latch the next frame
+        invalidate_latched_frame();
+
         // Initialize TLC5955
         tlc.init(LAT, SPI_MOSI, SPI_CLK, GSCLK);
+        Tlc5955Dma::begin(LAT);
 
         // We must set dot correction values, so set them all to the brightest adjustment
         tlc.set_all_dc_data(127);
@@ -417,30 +419,11 @@ int8_t LedArrayInterface::device_setup()
         }
 
         // Input trigger pins
-        attachInterrupt(digitalPinToInterrupt(trigger_input_pin_list[0]), trigger_pin_interrupt_0, CHANGE);
-        attachInterrupt(digitalPinToInterrupt(trigger_input_pin_list[1]), trigger_pin_interrupt_1, CHANGE);
+        setup_trigger_inputs();
         
         return NO_ERROR;
 }
 
-void LedArrayInterface::trigger_pin_interrupt_0()
-{
-        bool previous_state = trigger_input_state[0];
-        trigger_input_state[0] = digitalReadFast(trigger_input_pin_list[0]);
-        bool new_state = trigger_input_state[0];
-        if (debug >= 2)
-            Serial.printf("Recieved trigger pulse on pin 0. Previous state: %s New state: %s%s", previous_state ? "HIGH" : "LOW", new_state ? "HIGH" : "LOW", SERIAL_LINE_ENDING);
-}
-
-void LedArrayInterface::trigger_pin_interrupt_1()
-{
-    bool previous_state = trigger_input_state[1];
-    trigger_input_state[1] = digitalReadFast(trigger_input_pin_list[1]);
-    bool new_state = trigger_input_state[1];
-    if (debug >= 2)
-        Serial.printf("Recieved trigger pulse on pin 1. Previous state: %s New state: %s%s", previous_state ? "HIGH" : "LOW", new_state ? "HIGH" : "LOW", SERIAL_LINE_ENDING);
-}
-
 void LedArrayInterface::source_change_interrupt()
 {
         Serial.printf(F("ERROR (LedArrayInterface::source_change_interrupt): PSU Monitoring not supported on this device."), SERIAL_LINE_ENDING);
@@ -548,6 +531,8 @@ uint16_t LedArrayInterface::get_device_command_led_list_element(int device_comma
 
 void LedArrayInterface::set_gsclk_frequency(uint32_t gsclk_frequency)
 {
+  // Always send the next frame after a clock change
+  invalidate_latched_frame();
   tlc.set_gsclk_frequency(gsclk_frequency);
 }
 
@@ -558,6 +543,8 @@ uint32_t LedArrayInterface::get_gsclk_frequency()
 
 void LedArrayInterface::set_sclk_baud_rate(uint32_t new_baud_rate)
 {
+    // Always send the next frame after a clock change
+    invalidate_latched_frame();
     tlc.set_sclk_frequency(new_baud_rate);
 }
 
@@ -36,6 +36,8 @@
 #include "../../ledarrayinterface.h"
 #include "../../constants.h"
 #include "../TLC5955/TLC5955.h"
+#include "../../tlc5955dma.h"
+#include "../../triggeredges.h"
 #include <EEPROM.h>
 
 // Power monitoring commands
@@ -48,7 +50,7 @@
 #endif
 
 // Global shutter state
-bool global_shutter_state = true;
+bool LedArrayInterface::global_shutter_state = true;
 
 // Power sensing pin
 const int POWER_SENSE_PIN = 23;
@@ -85,6 +87,10 @@ const float LedArrayInterface::color_channel_fwhm_wavelengths_nm[] = {20.0};
 const int LedArrayInterface::bit_depth = 16;
 const bool LedArrayInterface::supports_fast_sequence = false;
 float LedArrayInterface::led_position_list_na[LedArrayInterface::led_count][2];
+float LedArrayInterface::led_position_list_na_radius[LedArrayInterface::led_count];
+uint16_t LedArrayInterface::led_na_sorted_list[LedArrayInterface::led_count];
+uint32_t LedArrayInterface::led_cosine_gain_list[LedArrayInterface::led_count];
+int16_t LedArrayInterface::led_channel_list[LedArrayInterface::led_count];
 
 const int LedArrayInterface::trigger_output_pin_list[] = {TRIGGER_OUTPUT_PIN_0};
 const int LedArrayInterface::trigger_input_pin_list[] = {TRIGGER_INPUT_PIN_0};
@@ -409,7 +415,7 @@ void LedArrayInterface::not_implemented(const char * command_name)
 
 uint16_t LedArrayInterface::get_led_value(uint16_t led_number, int color_channel_index)
 {
-    int16_t channel_number = (int16_t)pgm_read_word(&(led_positions[led_number][1]));
+    int16_t channel_number = led_channel_list[led_number];
     if (channel_number >= 0)
         return tlc.get_single_channel(channel_number);
     else
@@ -438,34 +444,6 @@ void LedArrayInterface::set_debug(int state)
         Serial.printf(F("(LedArrayInterface::set_debug): Set debug level to %d \n"), debug);
 }
 
-int LedArrayInterface::send_trigger_pulse(int trigger_index, uint16_t delay_us, bool inverse_polarity)
-{
-    // Get trigger pin
-    int trigger_pin = trigger_output_pin_list[trigger_index];
-
-    if (trigger_pin > 0)
-    {
-        // Write active state
-        if (inverse_polarity)
-            digitalWriteFast(trigger_pin, LOW);
-        else
-            digitalWriteFast(trigger_pin, HIGH);
-
-        // Delay if desired
-        if (delay_us > 0)
-            delayMicroseconds(delay_us);
-
-        // Write normal state
-        if (inverse_polarity)
-            digitalWriteFast(trigger_pin, HIGH);
-        else
-            digitalWriteFast(trigger_pin, LOW);
-        return 1;
-    }
-    else
-        return -1;
-}
-
 void LedArrayInterface::set_global_shutter_state(bool state)
 {
     if (debug >= 1)
@@ -497,16 +475,23 @@ bool LedArrayInterface::get_global_shutter_state()
 
 void LedArrayInterface::update()
 {
+    // Let any DMA transfer finish first, so updates are latched in order
+    Tlc5955Dma::wait();
+
     if (global_shutter_state)
+    {
+        if (is_frame_latched())
+            return;
+
         tlc.update();
+        TriggerTrace::record(TRIGGER_TRACE_LATCH, 0, true);
+        mark_frame_latched();
+    }
     else
+    {
         tlc.clear_without_modifying_pattern();
-}
-
-void LedArrayInterface::clear()
-{
-        tlc.set_all(0);
-        update();
+        invalidate_latched_frame();
+    }
 }
 
 void LedArrayInterface::set_channel(int16_t channel_number, int16_t color_channel_number, uint16_t value)
@@ -562,15 +547,15 @@ void LedArrayInterface::set_led(int16_t led_number, int16_t color_channel_number
 
     if (led_number < 0)
     {
+        // Whole-array writes go straight to the grayscale buffer
+        uint16_t * grayscale_data = &TLC5955::_grayscale_data[0][0][0];
         for (uint16_t led_index = 0; led_index < led_count; led_index++)
-        {
-            channel_number = (int16_t)pgm_read_word(&(led_positions[led_index][1]));
-            set_channel(channel_number, color_channel_number, value);
-        }
+            if (led_channel_list[led_index] >= 0)
+                grayscale_data[led_channel_list[led_index]] = value;
     }
     else
     {
-        channel_number = (int16_t)pgm_read_word(&(led_positions[led_number][1]));
+        channel_number = led_channel_list[led_number];
         set_channel(channel_number, color_channel_number, value);
     }
 
@@ -621,10 +606,18 @@ int8_t LedArrayInterface::device_reset()
 
 int8_t LedArrayInterface::device_setup()
 {   
+    // Cache the channel of each LED in RAM, rather than reading led_positions from flash on every update
+    for (uint16_t led_index = 0; led_index < led_count; led_index++)
+        led_channel_list[led_index] = (int16_t)pgm_read_word(&(led_positions[led_index][1]));
+
+    // The chips may have been reset, so always latch the next frame
+    invalidate_latched_frame();
+
     pinMode(LAT, OUTPUT);
 
     // Initialize TLC5955
     tlc.init(LAT, SPI_MOSI, SPI_CLK, GSCLK);
+    Tlc5955Dma::begin(LAT);
 
     // We must set dot correction values, so set them all to the brightest adjustment
     tlc.set_all_dc_data(127);
@@ -655,21 +648,12 @@ int8_t LedArrayInterface::device_setup()
     pinMode(LedArrayInterface::trigger_output_pin_list[0], OUTPUT);
     digitalWriteFast(LedArrayInterface::trigger_output_pin_list[0], LOW);
 
-    // Input trigger pin
-    attachInterrupt(digitalPinToInterrupt(trigger_input_pin_list[0]), trigger_pin_interrupt_0, CHANGE);
+    // Input trigger pins
+    setup_trigger_inputs();
 
     return NO_ERROR;
 }
 
-void LedArrayInterface::trigger_pin_interrupt_0()
-{
-        bool previous_state = trigger_input_state[0];
-        trigger_input_state[0] = digitalReadFast(trigger_input_pin_list[0]);
-        bool new_state = trigger_input_state[0];
-        if (debug >= 2)
-            Serial.printf("Recieved trigger pulse on pin 0. Previous state: %s New state: %s%s", previous_state ? "HIGH" : "LOW", new_state ? "HIGH" : "LOW", SERIAL_LINE_ENDING);
-}
-
 
 void LedArrayInterface::source_change_interrupt()
 {
@@ -780,6 +764,8 @@ uint16_t LedArrayInterface::get_device_command_led_list_element(int device_comma
 
 void LedArrayInterface::set_gsclk_frequency(uint32_t gsclk_frequency)
 {
+    // Always send the next frame after a clock change
+    invalidate_latched_frame();
     tlc.set_gsclk_frequency(gsclk_frequency);
 }
 
@@ -790,6 +776,8 @@ uint32_t LedArrayInterface::get_gsclk_frequency()
 
 void LedArrayInterface::set_sclk_baud_rate(uint32_t new_baud_rate)
 {
+    // Always send the next frame after a clock change
+    invalidate_latched_frame();
     tlc.set_sclk_frequency(new_baud_rate);
 }
 
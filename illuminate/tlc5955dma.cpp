@@ -0,0 +1,241 @@
+/*
+  Copyright (c) 2021, Zack Phillips
+  Copyright (c) 2018, Zachary Phillips (UC Berkeley)
+  All rights reserved.
+
+  BSD 3-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+      Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+      Neither the name of the UC Berkley nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL ZACHARY PHILLIPS (UC BERKELEY) BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA , OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tlc5955dma.h"
+#include "triggeredges.h"
+#include "src/TLC5955/TLC5955.h"
+
+uint8_t * Tlc5955Dma::bitstream = NULL;
+uint8_t * Tlc5955Dma::blank_bitstream = NULL;
+uint32_t Tlc5955Dma::bitstream_size = 0;
+int Tlc5955Dma::latch_pin = -1;
+volatile bool Tlc5955Dma::busy = false;
+volatile bool Tlc5955Dma::latch_on_complete = true;
+EventResponder Tlc5955Dma::transfer_event;
+void (* volatile Tlc5955Dma::latch_callback)() = NULL;
+
+volatile int8_t Tlc5955Dma::strobe_trigger_index = -1;
+volatile bool * volatile Tlc5955Dma::strobe_active_state = NULL;
+uint32_t Tlc5955Dma::strobe_timeout_ms = 60000;
+volatile uint8_t Tlc5955Dma::strobe_phase = STROBE_IDLE;
+uint32_t Tlc5955Dma::strobe_sclk_frequency = 0;
+
+void Tlc5955Dma::begin(int latch_pin)
+{
+  wait();
+  Tlc5955Dma::latch_pin = latch_pin;
+
+  // Round the chain up to whole bytes. The extra bits are sent first, so they are shifted out of the end of the chain.
+  uint32_t bit_count = (uint32_t)TLC5955::chip_count * TLC5955_GRAYSCALE_BITS_PER_CHIP;
+  if (bitstream == NULL)
+  {
+    bitstream_size = (bit_count + 7) / 8;
+    bitstream = new uint8_t[bitstream_size + 2]; // Allow packing to write past the last byte
+
+    // All-zero grayscale data, which turns every LED off
+    blank_bitstream = new uint8_t[bitstream_size];
+    memset(blank_bitstream, 0, bitstream_size);
+  }
+
+  transfer_event.attachImmediate(&Tlc5955Dma::transfer_complete);
+}
+
+bool Tlc5955Dma::is_busy()
+{
+  return busy;
+}
+
+void Tlc5955Dma::wait()
+{
+  // A strobed exposure in progress ends with a blank frame transfer, so wait for both
+  elapsedMillis elapsed_ms;
+  while (true)
+  {
+    __disable_irq();
+    if (!busy && (strobe_phase != STROBE_ON))
+    {
+      // Any new frame replaces a pattern which is still waiting for the strobe input
+      strobe_phase = STROBE_IDLE;
+      __enable_irq();
+      return;
+    }
+    __enable_irq();
+
+    // Turn the LEDs off if the exposure never ends (e.g. the camera was stopped)
+    if (elapsed_ms > strobe_timeout_ms)
+      end_exposure();
+  }
+}
+
+void Tlc5955Dma::set_strobe_input(int8_t trigger_index, volatile bool * active_state)
+{
+  // Stop handling edges, then blank any pattern latched for an exposure rather than waiting for the exposure to end
+  strobe_trigger_index = -1;
+  while (busy) {}
+  end_exposure();
+  wait();
+
+  strobe_active_state = active_state;
+  strobe_trigger_index = (active_state != NULL) ? trigger_index : -1;
+}
+
+void Tlc5955Dma::set_strobe_timeout(uint32_t timeout_ms)
+{
+  strobe_timeout_ms = timeout_ms;
+}
+
+void Tlc5955Dma::set_latch_callback(void (* callback)())
+{
+  latch_callback = callback;
+}
+
+int8_t Tlc5955Dma::get_strobe_input()
+{
+  return strobe_trigger_index;
+}
+
+/* Pack the grayscale data in the order TLC5955::update() shifts it: last chip first, then channels and colors in reverse */
+void Tlc5955Dma::pack_grayscale_data()
+{
+  memset(bitstream, 0, bitstream_size + 2);
+  uint32_t bit_index = bitstream_size * 8 - (uint32_t)TLC5955::chip_count * TLC5955_GRAYSCALE_BITS_PER_CHIP;
+
+  for (int16_t chip = TLC5955::chip_count - 1; chip >= 0; chip--)
+  {
+    // The control mode bit is zero for grayscale data
+    bit_index++;
+
+    for (int8_t led_channel_index = TLC5955::LEDS_PER_CHIP - 1; led_channel_index >= 0; led_channel_index--)
+    {
+      for (int8_t color_channel_index = TLC5955::COLOR_CHANNEL_COUNT - 1; color_channel_index >= 0; color_channel_index--)
+      {
+        uint8_t color_channel_ordered = TLC5955::_rgb_order[chip][led_channel_index][color_channel_index];
+        uint32_t value = (uint32_t)TLC5955::_grayscale_data[chip][led_channel_index][color_channel_ordered] << (8 - bit_index % 8);
+        uint8_t * destination = &bitstream[bit_index / 8];
+        destination[0] |= (value >> 16) & 0xFF;
+        destination[1] |= (value >> 8) & 0xFF;
+        destination[2] |= value & 0xFF;
+        bit_index += 16;
+      }
+    }
+  }
+}
+
+bool Tlc5955Dma::update_async(uint32_t sclk_frequency)
+{
+  if (bitstream == NULL)
+    return false;
+
+  // Only one transfer can use the bit-stream at a time
+  wait();
+  pack_grayscale_data();
+  start_transfer(bitstream, sclk_frequency, true);
+  return true;
+}
+
+bool Tlc5955Dma::shift_async(uint32_t sclk_frequency)
+{
+  if ((bitstream == NULL) || (strobe_trigger_index < 0))
+    return false;
+
+  wait();
+  pack_grayscale_data();
+  strobe_sclk_frequency = sclk_frequency;
+  start_transfer(bitstream, sclk_frequency, false);
+  return true;
+}
+
+void Tlc5955Dma::start_transfer(uint8_t * data, uint32_t sclk_frequency, bool latch)
+{
+  busy = true;
+  latch_on_complete = latch;
+  SPI.beginTransaction(SPISettings(sclk_frequency, MSBFIRST, SPI_MODE0));
+  SPI.transfer(data, NULL, bitstream_size, transfer_event);
+}
+
+void Tlc5955Dma::latch()
+{
+  digitalWrite(latch_pin, HIGH);
+  delayMicroseconds(1);
+  digitalWrite(latch_pin, LOW);
+}
+
+/* Sends the blank frame which ends a strobed exposure, if a pattern is latched and no transfer is running */
+bool Tlc5955Dma::end_exposure()
+{
+  __disable_irq();
+  bool exposure_on = !busy && (strobe_phase == STROBE_ON);
+  if (exposure_on)
+    busy = true;
+  __enable_irq();
+
+  if (exposure_on)
+    start_transfer(blank_bitstream, strobe_sclk_frequency, true);
+  return exposure_on;
+}
+
+/* Called from the DMA interrupt once the bit-stream has been sent */
+void Tlc5955Dma::transfer_complete(EventResponderRef event_responder)
+{
+  SPI.endTransaction();
+
+  // Latch the new grayscale data, or leave it in the shift registers for the strobe input to latch
+  if (latch_on_complete)
+  {
+    latch();
+    TriggerTrace::record(TRIGGER_TRACE_LATCH, 0, strobe_phase != STROBE_ON);
+    strobe_phase = STROBE_IDLE;
+  }
+  else
+    strobe_phase = STROBE_ARMED;
+
+  busy = false;
+
+  if (latch_on_complete && (latch_callback != NULL))
+    latch_callback();
+}
+
+/* Latches the waiting pattern when the exposure starts, then sends a blank frame when it ends */
+void Tlc5955Dma::trigger_edge(uint8_t trigger_index, bool state)
+{
+  if ((int8_t)trigger_index != strobe_trigger_index)
+    return;
+
+  // The polarity may be changed while strobe mode is enabled, so it is read at each edge
+  bool active = (state == *strobe_active_state);
+  if (active && (strobe_phase == STROBE_ARMED))
+  {
+    latch();
+    TriggerTrace::record(TRIGGER_TRACE_LATCH, 0, true);
+    strobe_phase = STROBE_ON;
+  }
+  else if (!active)
+    end_exposure();
+}
@@ -0,0 +1,90 @@
+/*
+  Copyright (c) 2021, Zack Phillips
+  Copyright (c) 2018, Zachary Phillips (UC Berkeley)
+  All rights reserved.
+
+  BSD 3-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+      Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+      Neither the name of the UC Berkley nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL ZACHARY PHILLIPS (UC BERKELEY) BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA , OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TLC5955DMA_H
+#define TLC5955DMA_H
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <EventResponder.h>
+
+// Number of bits shifted into each TLC5955 for a grayscale update (control bit + 48 x 16-bit channels)
+#define TLC5955_GRAYSCALE_BITS_PER_CHIP 769
+
+// Strobe phases
+#define STROBE_IDLE 0
+#define STROBE_ARMED 1      // Pattern shifted in (but not latched), waiting for the exposure to start
+#define STROBE_ON 2         // Pattern latched, waiting for the exposure to end
+
+// Asynchronous grayscale updates for a daisy-chain of TLC5955 chips. The grayscale data for the whole chain
+// is packed into a single bit-stream, which is sent by SPI DMA and latched when the transfer completes.
+//
+// In strobe mode, a pattern sent with shift_async() is only latched on the active edge of the strobe trigger input
+// (a camera exposure-active signal), and a blank frame is sent and latched on the inactive edge, so LEDs are only on
+// during exposures. The blank frame takes one chain shift time to appear, so exposures end slightly later than LEDs.
+class Tlc5955Dma {
+  public:
+    static void begin(int latch_pin);
+    static bool update_async(uint32_t sclk_frequency);  // Returns false if begin() has not been called
+    static bool shift_async(uint32_t sclk_frequency);   // Sends the pattern without latching, for the strobe input to latch
+    static bool is_busy();
+    static void set_latch_callback(void (* callback)());  // Called from the DMA interrupt after each frame is latched
+    static void wait();                                 // Also waits for a strobed exposure to end (up to the strobe timeout), then disarms the strobe
+
+    // Strobe input (a trigger input index, or -1 to disable). The active state is read from the polarity given at each edge.
+    static void set_strobe_input(int8_t trigger_index, volatile bool * active_state);
+    static void set_strobe_timeout(uint32_t timeout_ms);  // Longest exposure wait() will wait for before blanking the LEDs
+    static int8_t get_strobe_input();
+    static void trigger_edge(uint8_t trigger_index, bool state);  // Called from trigger input interrupts
+
+  private:
+    static void pack_grayscale_data();
+    static void start_transfer(uint8_t * data, uint32_t sclk_frequency, bool latch);
+    static void latch();
+    static bool end_exposure();
+    static void transfer_complete(EventResponderRef event_responder);
+
+    static uint8_t * bitstream;
+    static uint8_t * blank_bitstream;
+    static uint32_t bitstream_size;
+    static int latch_pin;
+    static volatile bool busy;
+    static volatile bool latch_on_complete;
+    static EventResponder transfer_event;
+    static void (* volatile latch_callback)();
+
+    static volatile int8_t strobe_trigger_index;
+    static volatile bool * volatile strobe_active_state;
+    static uint32_t strobe_timeout_ms;
+    static volatile uint8_t strobe_phase;
+    static uint32_t strobe_sclk_frequency;
+};
+
+#endif
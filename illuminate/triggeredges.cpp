@@ -0,0 +1,334 @@
+/*
+  Copyright (c) 2021, Zack Phillips
+  Copyright (c) 2018, Zachary Phillips (UC Berkeley)
+  All rights reserved.
+
+  BSD 3-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+      Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+      Neither the name of the UC Berkley nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL ZACHARY PHILLIPS (UC BERKELEY) BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA , OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "triggeredges.h"
+
+volatile trigger_edge_t TriggerEdgeQueue::queue[TRIGGER_CHANNEL_MAX][TRIGGER_EDGE_QUEUE_LENGTH];
+volatile uint16_t TriggerEdgeQueue::head[TRIGGER_CHANNEL_MAX];
+volatile uint16_t TriggerEdgeQueue::tail[TRIGGER_CHANNEL_MAX];
+volatile uint32_t TriggerEdgeQueue::dropped_count = 0;
+volatile uint32_t TriggerEdgeQueue::flush_on_latch_mask = 0;
+
+volatile uint32_t TriggerLatency::edge_cycle_count = 0;
+volatile bool TriggerLatency::edge_pending = false;
+volatile uint32_t TriggerLatency::last_cycles = 0;
+volatile uint32_t TriggerLatency::max_cycles = 0;
+volatile uint64_t TriggerLatency::total_cycles = 0;
+volatile uint32_t TriggerLatency::count = 0;
+
+volatile trigger_trace_entry_t TriggerTrace::trace[TRIGGER_TRACE_LENGTH];
+volatile uint32_t TriggerTrace::event_count = 0;
+
+void TriggerEdgeQueue::begin()
+{
+  // Enable the cycle counter, which is used for timestamps (this is already done at startup on some boards)
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+  flush();
+}
+
+/* Returns the previous interrupt mask, so this may be nested inside other critical sections (e.g. in latch interrupts) */
+static inline uint32_t disable_interrupts()
+{
+  uint32_t primask;
+  __asm__ volatile("mrs %0, primask\n" : "=r" (primask)::);
+  __disable_irq();
+  return primask;
+}
+
+static inline void restore_interrupts(uint32_t primask)
+{
+  if (!primask)
+    __enable_irq();
+}
+
+/* The tail is moved both by readers and by interrupts (which drop the oldest edge, or flush the queue on a latch), so it
+   is only changed with interrupts disabled */
+void TriggerEdgeQueue::push(uint8_t trigger_index, bool state)
+{
+  uint32_t cycle_count = ARM_DWT_CYCCNT;
+  if (trigger_index >= TRIGGER_CHANNEL_MAX)
+    return;
+
+  TriggerTrace::record(TRIGGER_TRACE_INPUT, trigger_index, state, cycle_count);
+
+  uint32_t primask = disable_interrupts();
+  uint16_t next_head = (head[trigger_index] + 1) & (TRIGGER_EDGE_QUEUE_LENGTH - 1);
+  if (next_head == tail[trigger_index])
+  {
+    tail[trigger_index] = (next_head + 1) & (TRIGGER_EDGE_QUEUE_LENGTH - 1);
+    dropped_count++;
+  }
+
+  queue[trigger_index][head[trigger_index]].cycle_count = cycle_count;
+  queue[trigger_index][head[trigger_index]].state = state;
+  head[trigger_index] = next_head;
+  restore_interrupts(primask);
+}
+
+bool TriggerEdgeQueue::pop(uint8_t trigger_index, bool state, trigger_edge_t * edge)
+{
+  if (trigger_index >= TRIGGER_CHANNEL_MAX)
+    return false;
+
+  bool found = false;
+  uint32_t primask = disable_interrupts();
+  while (!found && (tail[trigger_index] != head[trigger_index]))
+  {
+    uint16_t index = tail[trigger_index];
+    tail[trigger_index] = (index + 1) & (TRIGGER_EDGE_QUEUE_LENGTH - 1);
+    if (queue[trigger_index][index].state == state)
+    {
+      edge->cycle_count = queue[trigger_index][index].cycle_count;
+      edge->state = state;
+      found = true;
+    }
+  }
+  restore_interrupts(primask);
+  return found;
+}
+
+void TriggerEdgeQueue::flush()
+{
+  uint32_t primask = disable_interrupts();
+  for (int trigger_index = 0; trigger_index < TRIGGER_CHANNEL_MAX; trigger_index++)
+    tail[trigger_index] = head[trigger_index];
+  flush_on_latch_mask = 0;
+  restore_interrupts(primask);
+
+  // Nothing is waiting to be answered by a pattern once the edges are stale
+  TriggerLatency::disarm();
+}
+
+void TriggerEdgeQueue::flush(uint8_t trigger_index)
+{
+  if (trigger_index >= TRIGGER_CHANNEL_MAX)
+    return;
+
+  uint32_t primask = disable_interrupts();
+  tail[trigger_index] = head[trigger_index];
+  restore_interrupts(primask);
+}
+
+void TriggerEdgeQueue::flush_on_latch(uint8_t trigger_index)
+{
+  if (trigger_index >= TRIGGER_CHANNEL_MAX)
+    return;
+
+  uint32_t primask = disable_interrupts();
+  flush_on_latch_mask |= (1UL << trigger_index);
+  restore_interrupts(primask);
+}
+
+/* Called with interrupts disabled */
+void TriggerEdgeQueue::latched()
+{
+  for (int trigger_index = 0; flush_on_latch_mask != 0; trigger_index++)
+  {
+    if (flush_on_latch_mask & (1UL << trigger_index))
+    {
+      tail[trigger_index] = head[trigger_index];
+      flush_on_latch_mask &= ~(1UL << trigger_index);
+    }
+  }
+}
+
+uint32_t TriggerEdgeQueue::get_dropped_count()
+{
+  return dropped_count;
+}
+
+/* Measurements are updated from the latch interrupt, so they are read and written with interrupts disabled */
+void TriggerLatency::arm(uint32_t cycle_count)
+{
+  __disable_irq();
+  edge_cycle_count = cycle_count;
+  edge_pending = true;
+  __enable_irq();
+}
+
+void TriggerLatency::disarm()
+{
+  edge_pending = false;
+}
+
+/* Called with interrupts disabled */
+void TriggerLatency::latched(uint32_t cycle_count)
+{
+  if (!edge_pending)
+    return;
+
+  uint32_t latency_cycles = cycle_count - edge_cycle_count;
+  edge_pending = false;
+
+  last_cycles = latency_cycles;
+  if (latency_cycles > max_cycles)
+    max_cycles = latency_cycles;
+  total_cycles += latency_cycles;
+  count++;
+}
+
+void TriggerLatency::reset()
+{
+  __disable_irq();
+  last_cycles = 0;
+  max_cycles = 0;
+  total_cycles = 0;
+  count = 0;
+  __enable_irq();
+}
+
+void TriggerLatency::get_stats(trigger_latency_stats_t * stats)
+{
+  __disable_irq();
+  stats->count = count;
+  stats->last_cycles = last_cycles;
+  stats->max_cycles = max_cycles;
+  stats->mean_cycles = (count > 0) ? (uint32_t)(total_cycles / count) : 0;
+  __enable_irq();
+}
+
+void TriggerTrace::record(uint8_t event, uint8_t index, bool state)
+{
+  record(event, index, state, ARM_DWT_CYCCNT);
+}
+
+/* Events may come from interrupts of different priorities, so interrupts are disabled while an entry is written */
+void TriggerTrace::record(uint8_t event, uint8_t index, bool state, uint32_t cycle_count)
+{
+  uint32_t primask = disable_interrupts();
+
+  volatile trigger_trace_entry_t * entry = &trace[event_count & (TRIGGER_TRACE_LENGTH - 1)];
+  entry->cycle_count = cycle_count;
+  entry->event = event;
+  entry->index = index;
+  entry->state = state;
+  event_count++;
+
+  // Every path which latches a pattern records it here (blank strobe frames are recorded with a false state)
+  if ((event == TRIGGER_TRACE_LATCH) && state)
+  {
+    TriggerLatency::latched(cycle_count);
+    TriggerEdgeQueue::latched();
+  }
+
+  restore_interrupts(primask);
+}
+
+void TriggerTrace::reset()
+{
+  __disable_irq();
+  event_count = 0;
+  __enable_irq();
+}
+
+uint16_t TriggerTrace::snapshot(trigger_trace_entry_t * entries)
+{
+  __disable_irq();
+  uint32_t count = event_count;
+  uint16_t entry_count = (count < TRIGGER_TRACE_LENGTH) ? count : TRIGGER_TRACE_LENGTH;
+  for (uint16_t entry_index = 0; entry_index < entry_count; entry_index++)
+  {
+    const volatile trigger_trace_entry_t * entry = &trace[(count - entry_count + entry_index) & (TRIGGER_TRACE_LENGTH - 1)];
+    entries[entry_index].cycle_count = entry->cycle_count;
+    entries[entry_index].event = entry->event;
+    entries[entry_index].index = entry->index;
+    entries[entry_index].state = entry->state;
+  }
+  __enable_irq();
+  return entry_count;
+}
+
+uint32_t TriggerTrace::get_event_count()
+{
+  return event_count;
+}
+
+/* Statistics are computed in one pass. Rather than sorting every interval, only the longest few are kept (in
+   descending order), which always includes the 99th percentile interval. */
+void TriggerTrace::get_jitter_stats(const trigger_trace_entry_t * entries, uint16_t entry_count, uint8_t from_event, uint8_t to_event, trigger_jitter_stats_t * stats)
+{
+  uint16_t interval_count = 0;
+  uint64_t total_cycles = 0;
+  uint32_t from_cycle_count = 0;
+  bool from_seen = false;
+  uint32_t longest_intervals[TRIGGER_TRACE_P99_LENGTH];
+  uint16_t longest_count = 0;
+
+  memset(stats, 0, sizeof(trigger_jitter_stats_t));
+  stats->min_cycles = UINT32_MAX;
+
+  for (uint16_t entry_index = 0; entry_index < entry_count; entry_index++)
+  {
+    const trigger_trace_entry_t * entry = &entries[entry_index];
+    if (((entry->event == TRIGGER_TRACE_OUTPUT) || (entry->event == TRIGGER_TRACE_LATCH)) && !entry->state)
+      continue;
+
+    if ((entry->event == to_event) && from_seen)
+    {
+      uint32_t interval = entry->cycle_count - from_cycle_count;
+      total_cycles += interval;
+      interval_count++;
+      stats->min_cycles = min(stats->min_cycles, interval);
+      from_seen = false;
+
+      // Insert into the longest intervals, dropping the shortest of them if full
+      if ((longest_count < TRIGGER_TRACE_P99_LENGTH) || (interval > longest_intervals[longest_count - 1]))
+      {
+        uint16_t insert_index = (longest_count < TRIGGER_TRACE_P99_LENGTH) ? longest_count++ : longest_count - 1;
+        while ((insert_index > 0) && (longest_intervals[insert_index - 1] < interval))
+        {
+          longest_intervals[insert_index] = longest_intervals[insert_index - 1];
+          insert_index--;
+        }
+        longest_intervals[insert_index] = interval;
+      }
+    }
+
+    if (entry->event == from_event)
+    {
+      from_cycle_count = entry->cycle_count;
+      from_seen = true;
+    }
+  }
+
+  stats->count = interval_count;
+  if (interval_count == 0)
+  {
+    stats->min_cycles = 0;
+    return;
+  }
+
+  // The 99th percentile is at index (interval_count * 99 + 99) / 100 - 1 in ascending order
+  uint16_t p99_rank = interval_count - ((uint32_t)interval_count * 99 + 99) / 100;
+  stats->max_cycles = longest_intervals[0];
+  stats->mean_cycles = (uint32_t)(total_cycles / interval_count);
+  stats->p99_cycles = longest_intervals[p99_rank];
+}
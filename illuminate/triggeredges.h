@@ -0,0 +1,149 @@
+/*
+  Copyright (c) 2021, Zack Phillips
+  Copyright (c) 2018, Zachary Phillips (UC Berkeley)
+  All rights reserved.
+
+  BSD 3-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+      Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+      Neither the name of the UC Berkley nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL ZACHARY PHILLIPS (UC BERKELEY) BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA , OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TRIGGEREDGES_H
+#define TRIGGEREDGES_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+// Number of edges which may be waiting to be read on each trigger input (must be a power of two)
+#define TRIGGER_EDGE_QUEUE_LENGTH 16
+
+// Rate of the cycle counter used to timestamp edges
+#ifdef F_CPU_ACTUAL
+#define TRIGGER_CYCLES_PER_SECOND F_CPU_ACTUAL
+#else
+#define TRIGGER_CYCLES_PER_SECOND F_CPU
+#endif
+
+typedef struct trigger_edge {
+  uint32_t cycle_count;    // ARM_DWT_CYCCNT when the edge was seen
+  bool state;              // Input state after the edge
+} trigger_edge_t;
+
+// Queues of timestamped edges for each trigger input, filled by the trigger pin interrupts. Edges stay queued until
+// they are read or the pattern answering them is latched, so waiting on one input never discards edges from another.
+// When a queue is full the oldest edge is dropped, since the newest edges are the ones a sequence is waiting for.
+class TriggerEdgeQueue {
+  public:
+    static void begin();
+    static void push(uint8_t trigger_index, bool state);  // Called from trigger input interrupts
+    static bool pop(uint8_t trigger_index, bool state, trigger_edge_t * edge);  // Oldest edge to the given state (older edges are discarded)
+    static void flush();
+    static void flush(uint8_t trigger_index);
+    static void flush_on_latch(uint8_t trigger_index);  // Flushes the input when the next pattern is latched
+    static void latched();                              // Called by TriggerTrace for every pattern latch
+    static uint32_t get_dropped_count();
+
+  private:
+    static volatile trigger_edge_t queue[TRIGGER_CHANNEL_MAX][TRIGGER_EDGE_QUEUE_LENGTH];
+    static volatile uint16_t head[TRIGGER_CHANNEL_MAX];
+    static volatile uint16_t tail[TRIGGER_CHANNEL_MAX];
+    static volatile uint32_t dropped_count;
+    static volatile uint32_t flush_on_latch_mask;       // Bit for each trigger index
+};
+
+typedef struct trigger_latency_stats {
+  uint32_t count;          // Number of latches measured
+  uint32_t last_cycles;
+  uint32_t mean_cycles;
+  uint32_t max_cycles;
+} trigger_latency_stats_t;
+
+// Latency from the trigger input edge a sequence waited for to the latch which shows the next pattern. Waiting for an
+// edge arms a measurement, which is taken when the pattern is latched (on the DMA interrupt for asynchronous updates).
+class TriggerLatency {
+  public:
+    static void arm(uint32_t edge_cycle_count);  // Call once the previous pattern has been latched
+    static void disarm();
+    static void latched(uint32_t cycle_count);   // Called by TriggerTrace for every pattern latch
+    static void reset();
+    static void get_stats(trigger_latency_stats_t * stats);
+
+  private:
+    static volatile uint32_t edge_cycle_count;
+    static volatile bool edge_pending;
+    static volatile uint32_t last_cycles;
+    static volatile uint32_t max_cycles;
+    static volatile uint64_t total_cycles;
+    static volatile uint32_t count;
+};
+
+// Number of events kept by the trigger trace (must be a power of two). The trace is copied before it is printed, so
+// it uses twice this many entries of RAM, which is sized for the available RAM as sequences are.
+#if defined(__IMXRT1062__)
+#define TRIGGER_TRACE_LENGTH 512
+#else
+#define TRIGGER_TRACE_LENGTH 64
+#endif
+
+// Number of the longest intervals kept to find the 99th percentile interval
+#define TRIGGER_TRACE_P99_LENGTH (TRIGGER_TRACE_LENGTH / 100 + 2)
+
+// Trigger trace event types
+#define TRIGGER_TRACE_LATCH 0           // LED pattern latched (state is false for strobe mode blank frames)
+#define TRIGGER_TRACE_OUTPUT 1          // Trigger output edge (state is true at the start of a pulse)
+#define TRIGGER_TRACE_INPUT 2           // Trigger input edge
+
+typedef struct trigger_trace_entry {
+  uint32_t cycle_count;    // ARM_DWT_CYCCNT when the event happened
+  uint8_t event;           // TRIGGER_TRACE_*
+  uint8_t index;           // Trigger index (zero for latches)
+  bool state;
+} trigger_trace_entry_t;
+
+typedef struct trigger_jitter_stats {
+  uint32_t count;          // Number of intervals measured
+  uint32_t min_cycles;
+  uint32_t mean_cycles;
+  uint32_t max_cycles;
+  uint32_t p99_cycles;
+} trigger_jitter_stats_t;
+
+// Ring buffer of the most recent latch and trigger edge timestamps, used to measure how tightly they line up.
+// Events may be recorded from any interrupt. Intervals longer than one cycle counter period (a few seconds) wrap.
+class TriggerTrace {
+  public:
+    static void record(uint8_t event, uint8_t index, bool state);
+    static void record(uint8_t event, uint8_t index, bool state, uint32_t cycle_count);
+    static void reset();
+    static uint16_t snapshot(trigger_trace_entry_t * entries);  // Copies events, oldest first, returning the number copied
+    static uint32_t get_event_count();
+
+    // Intervals from each from_event to the first following to_event (output pulse ends and blank frames are ignored)
+    static void get_jitter_stats(const trigger_trace_entry_t * entries, uint16_t entry_count, uint8_t from_event, uint8_t to_event, trigger_jitter_stats_t * stats);
+
+  private:
+    static volatile trigger_trace_entry_t trace[TRIGGER_TRACE_LENGTH];
+    static volatile uint32_t event_count;
+};
+
+#endif
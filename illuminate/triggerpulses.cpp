@@ -0,0 +1,208 @@
+/*
+  Copyright (c) 2021, Zack Phillips
+  Copyright (c) 2018, Zachary Phillips (UC Berkeley)
+  All rights reserved.
+
+  BSD 3-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+      Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+      Neither the name of the UC Berkley nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL ZACHARY PHILLIPS (UC BERKELEY) BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA , OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "triggerpulses.h"
+#include "triggeredges.h"
+
+TriggerPulses::trigger_pulse_t TriggerPulses::pulses[TRIGGER_CHANNEL_MAX];
+IntervalTimer TriggerPulses::timers[TRIGGER_CHANNEL_MAX];
+volatile bool TriggerPulses::reserved[TRIGGER_CHANNEL_MAX];
+volatile uint32_t TriggerPulses::dropped_count = 0;
+void (* const TriggerPulses::timer_interrupts[TRIGGER_CHANNEL_MAX])() = {timer_interrupt<0>, timer_interrupt<1>, timer_interrupt<2>, timer_interrupt<3>,
+                                                                         timer_interrupt<4>, timer_interrupt<5>, timer_interrupt<6>, timer_interrupt<7>};
+static_assert(TRIGGER_CHANNEL_MAX == 8, "TriggerPulses::timer_interrupts must have an entry for each trigger channel");
+
+/* Starts a pulse on the given pin, returning immediately. If the channel is still busy with a previous pulse, or no
+   interval timer is free, this waits if may_wait is set. Otherwise (which must be the case in interrupts) the pulse
+   is dropped and counted, and false is returned. */
+bool TriggerPulses::send(uint8_t channel, int pin, uint32_t width_us, uint32_t holdoff_us, bool inverse_polarity, bool may_wait)
+{
+  if (channel >= TRIGGER_CHANNEL_MAX)
+    return false;
+
+  if (is_busy(channel))
+  {
+    if (!may_wait)
+    {
+      dropped_count++;
+      return false;
+    }
+    while (is_busy(channel)) {}
+  }
+
+  trigger_pulse_t * pulse = &pulses[channel];
+  pulse->pin = pin;
+  pulse->holdoff_us = holdoff_us;
+  pulse->inverse_polarity = inverse_polarity;
+
+  if (width_us > 0)
+  {
+    // The timer is started before the active state is written, so the pulse is not started unless it can be ended.
+    // Interrupts are disabled in between so the timer cannot end the pulse before it starts.
+    uint32_t primask;
+    __asm__ volatile("mrs %0, primask\n" : "=r" (primask)::);
+    __disable_irq();
+    pulse->phase = TRIGGER_PULSE_ACTIVE;
+    bool timer_started = timers[channel].begin(timer_interrupts[channel], width_us);
+    if (timer_started || may_wait)
+    {
+      digitalWriteFast(pin, inverse_polarity ? LOW : HIGH);
+      TriggerTrace::record(TRIGGER_TRACE_OUTPUT, channel, true);
+    }
+    else
+    {
+      pulse->phase = TRIGGER_PULSE_IDLE;
+      dropped_count++;
+    }
+    if (!primask)
+      __enable_irq();
+
+    if (!timer_started)
+    {
+      if (!may_wait)
+        return false;
+      delayMicroseconds(width_us);
+      end_pulse(channel, true);
+    }
+  }
+  else
+  {
+    digitalWriteFast(pin, inverse_polarity ? LOW : HIGH);
+    TriggerTrace::record(TRIGGER_TRACE_OUTPUT, channel, true);
+    end_pulse(channel, may_wait);
+  }
+
+  return true;
+}
+
+bool TriggerPulses::is_busy(uint8_t channel)
+{
+  return (pulses[channel].phase != TRIGGER_PULSE_IDLE);
+}
+
+void TriggerPulses::wait_all()
+{
+  for (uint8_t channel = 0; channel < TRIGGER_CHANNEL_MAX; channel++)
+    while (is_busy(channel)) {}
+}
+
+/* Reserves an interval timer for the channel, so pulses sent from interrupts are never dropped for lack of one.
+   Returns false if no timer is free. */
+bool TriggerPulses::reserve(uint8_t channel)
+{
+  if (channel >= TRIGGER_CHANNEL_MAX)
+    return false;
+
+  // Wait for a pulse on an unreserved timer to finish, since the timer is restarted here
+  while (is_busy(channel)) {}
+  if (reserved[channel])
+    return true;
+
+  if (!timers[channel].begin(timer_interrupts[channel], TRIGGER_PULSE_RESERVED_PERIOD_US))
+    return false;
+  reserved[channel] = true;
+  return true;
+}
+
+/* Releases all reserved timers. Channels which are still busy release their timer when their pulse ends.
+   This may be called from interrupts. */
+void TriggerPulses::release_all()
+{
+  uint32_t primask;
+  __asm__ volatile("mrs %0, primask\n" : "=r" (primask)::);
+  __disable_irq();
+
+  for (uint8_t channel = 0; channel < TRIGGER_CHANNEL_MAX; channel++)
+  {
+    if (reserved[channel] && !is_busy(channel))
+      timers[channel].end();
+    reserved[channel] = false;
+  }
+
+  if (!primask)
+    __enable_irq();
+}
+
+uint32_t TriggerPulses::get_dropped_count()
+{
+  return dropped_count;
+}
+
+void TriggerPulses::reset_dropped_count()
+{
+  dropped_count = 0;
+}
+
+/* Writes the normal state, then starts the hold-off period (if any). Without a free timer, the hold-off is timed by
+   busy-waiting if may_wait is set, or skipped otherwise. */
+void TriggerPulses::end_pulse(uint8_t channel, bool may_wait)
+{
+  trigger_pulse_t * pulse = &pulses[channel];
+  digitalWriteFast(pulse->pin, pulse->inverse_polarity ? HIGH : LOW);
+  TriggerTrace::record(TRIGGER_TRACE_OUTPUT, channel, false);
+
+  if (pulse->holdoff_us > 0)
+  {
+    // In the timer interrupt, the timer which just ended is always free
+    pulse->phase = TRIGGER_PULSE_HOLDOFF;
+    if (!timers[channel].begin(timer_interrupts[channel], pulse->holdoff_us))
+    {
+      if (may_wait)
+        delayMicroseconds(pulse->holdoff_us);
+      pulse->phase = TRIGGER_PULSE_IDLE;
+    }
+  }
+  else
+  {
+    pulse->phase = TRIGGER_PULSE_IDLE;
+
+    // Keep a reserved timer, but slow it down while the channel is idle
+    if (reserved[channel])
+      timers[channel].begin(timer_interrupts[channel], TRIGGER_PULSE_RESERVED_PERIOD_US);
+  }
+}
+
+/* Interval timer interrupt for each channel. Unreserved timers are restarted for each phase, so they only fire once
+   per phase. Reserved timers keep running (and keep their channel), so they also fire while the channel is idle. */
+template <uint8_t channel>
+void TriggerPulses::timer_interrupt()
+{
+  if (!reserved[channel])
+    timers[channel].end();
+
+  if (pulses[channel].phase == TRIGGER_PULSE_ACTIVE)
+    end_pulse(channel, false);
+  else if (pulses[channel].phase == TRIGGER_PULSE_HOLDOFF)
+  {
+    pulses[channel].phase = TRIGGER_PULSE_IDLE;
+    if (reserved[channel])
+      timers[channel].begin(timer_interrupts[channel], TRIGGER_PULSE_RESERVED_PERIOD_US);
+  }
+}
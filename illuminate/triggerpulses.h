@@ -0,0 +1,81 @@
+/*
+  Copyright (c) 2021, Zack Phillips
+  Copyright (c) 2018, Zachary Phillips (UC Berkeley)
+  All rights reserved.
+
+  BSD 3-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+      Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+      Neither the name of the UC Berkley nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL ZACHARY PHILLIPS (UC BERKELEY) BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA , OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TRIGGERPULSES_H
+#define TRIGGERPULSES_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+// Pulse phases
+#define TRIGGER_PULSE_IDLE 0
+#define TRIGGER_PULSE_ACTIVE 1
+#define TRIGGER_PULSE_HOLDOFF 2
+
+// Period of a reserved timer while its channel is idle
+#define TRIGGER_PULSE_RESERVED_PERIOD_US ((uint32_t)1000000)
+
+// Trigger output pulses generated by interval timers, so the CPU is free while they are sent. After each pulse,
+// the channel stays busy for a hold-off period, which lets callers wait for devices to respond before continuing.
+// There are fewer interval timers than trigger channels. Outside interrupts, pulses are timed by busy-waiting when
+// no timer is free. Interrupts never wait: pulses which cannot be sent are dropped and counted, so channels used
+// from interrupts should be reserved first.
+class TriggerPulses {
+  public:
+    static bool send(uint8_t channel, int pin, uint32_t width_us, uint32_t holdoff_us, bool inverse_polarity, bool may_wait);
+    static bool is_busy(uint8_t channel);
+    static void wait_all();
+
+    // Reserved channels keep their interval timer between pulses, until released
+    static bool reserve(uint8_t channel);
+    static void release_all();
+
+    static uint32_t get_dropped_count();
+    static void reset_dropped_count();
+
+  private:
+    typedef struct trigger_pulse {
+      int pin;
+      uint32_t holdoff_us;
+      bool inverse_polarity;
+      volatile uint8_t phase;
+    } trigger_pulse_t;
+
+    static void end_pulse(uint8_t channel, bool may_wait);
+    template <uint8_t channel> static void timer_interrupt();
+
+    static trigger_pulse_t pulses[TRIGGER_CHANNEL_MAX];
+    static IntervalTimer timers[TRIGGER_CHANNEL_MAX];
+    static volatile bool reserved[TRIGGER_CHANNEL_MAX];
+    static volatile uint32_t dropped_count;
+    static void (* const timer_interrupts[TRIGGER_CHANNEL_MAX])();
+};
+
+#endif